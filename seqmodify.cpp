@@ -1,789 +1,7870 @@
-//---------------------------------------------------------------
-// Two vectors of integers. One represents a specification
-// or configuration of data records that must be captured.
-// Each record is identified by a non-zero integer, so the
-// specification vector may look like:
-//	{ 1, 4, 8, 9 } meaning that 4 data records must be
-// captured, and they'll be identified #1, #4, #8 and #9.
-// The numbers will always be in ascending order, but don't
-// have to be contiguous.
-//
-// The second vector represents a file in which data is being
-// captured. Since the specification vector indicates 4
-// records must be captured, the second vector starts out
-// with 4 zeros: { 0, 0, 0, 0 }. As data capture proceeds,
-// these "empty" records are replaced with the corresponding
-// specification numbers, so the second vector should end
-// up identical to the first: { 1, 4, 8, 9 }.
-//
-// One wrinkle is that we may get the second vector in an
-// intermediate state, where some or all of the entries are
-// still the initial zero value, e.g.: { 1, 0, 0, 9 }.
-//
-// The problem is, if the specification vector changes
-// (elements may be added or deleted, but will remain in
-// ascending order), how to bring the second vector in sync,
-// since some of the elements may still have the initial
-// zero values?
-//
-// Example:
-// The original specification vector was { 1, 4, 8, 9 }.
-// A file vector is created with initial zeros { 0, 0, 0, 0 };
-// One record gets populated with the identifying number:
-// { 0, 0, 8, 0 }.
-// Now, the specification changes. 4 is removed and 10 is added
-// to the end: { 1, 8, 9, 10 }. 
-// We have to remove the entry in the file vector that corresponds
-// to the entry removed from the specification vector, and we 
-// have to add a zero-filled entry in the position where 
-// new specification entry was added. 
-// We are given the new state of the specification vector and
-// the current state of the file vector:
-// Spec = { 1, 8, 9, 10 }
-// File = { 0, 0, 8, 0 }
-//---------------------------------------------------------------
-#include <vector>
-#include <stdio.h>
-#include <string>
-using namespace std;
-
-//---------------------------------------------------------------
-// globals
-//---------------------------------------------------------------
-int FailCount = 0;
-
-struct NotFoundSeq {
-	int start;
-	int end;
-};
-
-//---------------------------------------------------------------
-// forward declarations
-//---------------------------------------------------------------
-int removeZeros(vector<int> &as, vector<int> &wf);
-
-//---------------------------------------------------------------
-// utility functions
-//---------------------------------------------------------------
-// make it easier to initialize vectors in one line
-// in test program
-void
-loadVec(vector<int> &vec, const string &s)
-{
-	vec.clear();
-	string eat = s;
-	string part;
-	while (eat.length())
-	{
-		size_t pos = eat.find(",");
-		if (pos != string::npos)
-		{
-			part = eat.substr(0, pos);
-			eat = eat.substr(pos+1);
-		}
-		else
-		{
-			part = eat;
-			eat = "";
-		}
-		vec.push_back(atoi(part.c_str()));
-	}
-}
-
-// debug logging
-void
-logVecs(vector<int> &asFields, vector<int> &wfFields)
-{
-	unsigned int max = asFields.size();
-	if (wfFields.size() > max)
-		max = wfFields.size();
-
-	string line = "   Config         Actual \n";
-	for (unsigned int i = 0; i < max; i++)
-	{
-		char buf[8];
-		if (asFields.size() > i)
-		{
-			sprintf(buf, "     %d", asFields[i]);
-			line += buf;
-			if (strlen(buf) == 6)
-				line += " ";
-		}
-		else
-			line += "       ";
-		line += "            ";
-		if (wfFields.size() > i)
-		{
-			sprintf(buf, "%d", wfFields[i]);
-			line += buf;
-		}
-		line += "\n";
-	}
-	printf("%s", line.c_str());
-}
-
-// debug logging
-void
-logPossibles(vector<int> const &possibles, const char *text)
-{
-	string log = text;
-	log += ": ";
-	vector<int>::const_iterator it;
-	for (it = possibles.begin(); it != possibles.end(); it++)
-	{   
-		char buf[8];
-		sprintf(buf, "%d", (*it));
-		log += buf;
-		log += ", ";
-	}
-	log += "\n";
-	printf("%s", log.c_str());
-}
-
-bool
-fldNumListsMatch(vector<int> &as, vector<int> &wf)
-{
-	if (as.size() != wf.size())
-		return false;
-
-	bool matched = true;
-	for (unsigned int i = 0; i < as.size(); i++)
-	{
-		if (wf[i] != 0 && wf[i] != as[i])
-		{
-			matched = false;
-			break;
-		}
-	}
-	return matched;
-}
-
-void
-makeNotFoundVector(vector<NotFoundSeq> &nfsVec, vector<int> &a, vector<int> &w)
-{
-	// scan the a vector. for each element, scan the w vector
-	// and count whether it is found or not
-	vector<int>::iterator aIt;
-	vector<int>::iterator wIt;
-	int pos = 1;
-	int seqStart = 0;
-	int seqEnd = 0;
-	for (aIt = a.begin(); aIt != a.end(); aIt++)
-	{
-		bool found = false;
-		for (wIt = w.begin(); wIt != w.end(); wIt++)
-		{
-			if ((*aIt) == (*wIt))
-			{
-				found = true;
-				break;
-			}
-		}
-		if (found)
-		{
-			// if we have a sequence of not found, store it in vector
-			if (seqStart)
-			{
-				NotFoundSeq nfs;
-				nfs.start = seqStart;
-				nfs.end = seqEnd;
-				nfsVec.push_back(nfs);
-				seqStart = 0;
-				seqEnd = 0;
-			}
-		}
-		else
-		{
-			if (!seqStart)
-				seqStart = pos;
-			seqEnd = pos;
-		}
-		pos++;
-	}
-	// if we have an unfinished sequence of not found, store it in vector
-	if (seqStart)
-	{
-		NotFoundSeq nfs;
-		nfs.start = seqStart;
-		nfs.end = pos-1;;
-		nfsVec.push_back(nfs);
-		seqStart = 0;
-		seqEnd = 0;
-	}
-}
-
-void
-logNotFoundVector(vector<NotFoundSeq> &nfsVec)
-{
-	string str = "nfsVec:\n";
-	vector<NotFoundSeq>::iterator nfsIt;
-	for (nfsIt = nfsVec.begin(); nfsIt != nfsVec.end(); nfsIt++)
-	{
-		str += "sequence start=";
-		char buf[8];
-		sprintf(buf, "%d", (*nfsIt).start);
-		str += buf;
-		str += ", end=";
-		sprintf(buf, "%d", (*nfsIt).end);
-		str += buf;
-		str += "\n";
-	}
-	printf("%s", str.c_str());
-}
-
-// call this after any non-zero values in w that aren't in a
-// have already been removed. this function figures out what elements
-// in a don't appear in w, and makes sure that there are corresponding
-// 0s in w in the right positions for those missing elements from a.
-//
-// it does this by making a list of sequences of a values that aren't
-// found in w.
-// each sequence is either:
-// i) starting at position 1
-// ii) ending at end of vector a (not exclusive of i)
-// iii) sandwiched between found elements
-//
-// if (i) then vector w must begin with a sequence of 0's
-//  as long as the not-found sequence.
-// if (ii) then vector w must end with a sequence of 0's
-//  as long as the not-found sequence.
-// if (iii) then there are found positions before and
-//  after the sequence. the distance between them in
-//  vector w must be the same as the distance
-//  between them in vector a.
-//
-// set pos to 0 to prepend at beginning of w vector
-// set pos to N to insert after pos N in w vector
-// set pos to -N to delete from position N in w vector
-bool
-fixingW(vector<int> &a, vector<int> &w, int &pos)
-{
-	if (fldNumListsMatch(a, w))
-		return false;
-	if (w.size() == 0 && a.size() > 0)
-	{
-		pos = 0;
-		return true;
-	}
-
-	vector<NotFoundSeq> nfsVec;
-
-	makeNotFoundVector(nfsVec, a, w);
-
-	printf("fixingW, a size=%u, w size=%u, nfsVec.size=%u\n"
-			, a.size(), w.size(), nfsVec.size());
-
-	if (nfsVec.size() == 0)
-		return false;
-
-	logNotFoundVector(nfsVec);
-	vector<NotFoundSeq>::iterator nfsIt;
-
-	int beforePosA = 0;
-	int afterPosA = 0;
-	int beforeVal = 0;
-	int afterVal = 0;
-	int beforePosW = 0;
-	int afterPosW = 0;
-	for (nfsIt = nfsVec.begin(); nfsIt != nfsVec.end(); nfsIt++)
-	{
-		if ((*nfsIt).start == 1)
-		{
-			// special case for all zeros in w
-			if ((*nfsIt).end == (int)a.size())
-			{
-				if (a.size() == w.size())
-					return false;
-				else if (w.size() < a.size())
-				{
-					pos = 0;
-					return true;
-				}
-				else	// w.size() > a.size()
-				{
-					pos = -1;
-					return true;
-				}
-			}
-			// case i)
-			afterPosA = (*nfsIt).end+1;
-			afterVal = a[afterPosA-1];
-			afterPosW = 0;
-			for (unsigned int i = 0; i < w.size(); i++)
-			{
-				if (w[i] == afterVal)
-				{
-					afterPosW = i+1;
-					break;
-				}
-			}
-			if (afterPosW == afterPosA)
-				continue;
-			else if (afterPosW < afterPosA)
-			{
-				// too few 0s at beginning
-				pos = 0;
-				return true;
-			}
-			else	// afterPosW > afterPosA
-			{
-				// too many 0s at beginning
-				pos = -1;
-				return true;
-			}
-		}
-		else if ((*nfsIt).end == (int)a.size())
-		{
-			// case ii)
-			beforePosA = (*nfsIt).start-1;
-			beforeVal = a[beforePosA-1];
-			beforePosW = 0;
-			for (unsigned int i = 1; i <= w.size(); i++)
-			{
-				unsigned int idx = (w.size() - i);
-				if (w[idx] == beforeVal)
-				{
-					beforePosW = idx+1;
-					break;
-				}
-			}
-			int fromEndA = a.size() - beforePosA;
-			int fromEndW = w.size() - beforePosW;
-			if (fromEndA == fromEndW)
-				continue;
-			else if (fromEndA < fromEndW)
-			{
-				// too many 0s at end
-				pos = (0 - w.size());
-				return true;
-			}
-			else	// fromEndA > fromEndW
-			{
-				// too few 0s at end
-				pos = w.size();
-				return true;
-			}
-		}
-		else
-		{
-			// case iii)
-			beforePosW = 0;
-			afterPosW = 0;
-			beforePosA = (*nfsIt).start-1;
-			beforeVal = a[beforePosA-1];
-			afterPosA = (*nfsIt).end+1;
-			afterVal = a[afterPosA-1];
-			for (unsigned int i = 0; i < w.size(); i++)
-			{
-				if (w[i] == beforeVal)
-					beforePosW = i+1;
-				else if (w[i] == afterVal)
-					afterPosW = i+1;
-			}
-			int aLen = afterPosA - beforePosA;
-			int wLen = afterPosW - beforePosW;
-			if (aLen == wLen)
-				continue;
-			else if (aLen < wLen)
-			{
-				// there are too many 0s
-				pos = 0 - (beforePosW+1);
-				return true;
-			}
-			else	// aLen > wLen
-			{
-				// there are too few 0s
-				pos = (beforePosW);
-				return true;
-			}
-		}
-	}
-
-	return false;
-}
-
-// make a list of everything in the suspect vector that
-// is not represented in the reference vector
-void
-findPossibles(vector<int> &possibles, const vector<int> suspect
-		, const vector<int> reference)
-{
-	possibles.clear();
-	vector<int>::const_iterator it;
-	for (unsigned int i = 0; i < suspect.size(); i++)
-	{
-		int search = suspect[i];
-		bool found = false;
-		for (unsigned int j = 0; j < reference.size(); j++)
-		{
-			int comp = reference[j];
-			if (comp == search)
-			{
-				found = true;
-				break;
-			}
-		}
-		if (!found && search != 0)
-			possibles.push_back(search);
-	}
-}
-
-// scan forward through wf vector looking for the first non-zero
-// value after 'start' pos, and record its index. then find the 
-// matching value in the as vector, and record its index.
-bool
-findPosMatchedVals(unsigned int start, vector<int> &as, vector<int> &wf
-		, int &matchedVal, unsigned int &asPos, unsigned int &wfPos)
-{
-	bool changed = false;
-	unsigned int savedASPos = asPos;
-	unsigned int savedWFPos = wfPos;
-	for (unsigned int i = start; i <= wf.size(); i++)
-	{
-		if (wf[i] != 0)
-		{
-			matchedVal = wf[i];
-			wfPos = i+1;
-			break;
-		}
-	}
-	for (unsigned int i = start; i <= as.size(); i++)
-	{
-		if (as[i] == matchedVal)
-		{
-			asPos = i+1;
-			changed = true;
-			break;
-		}
-	}
-	if (!changed)
-	{
-		wfPos = savedWFPos;
-		asPos = savedASPos;
-	}
-	return (changed);
-}
-
-int
-removeZeros(vector<int> &as, vector<int> &wf)
-{
-	// if wf vector is all 0s, we can just return the
-	// first position
-	if (wf.size() > as.size())
-	{
-		vector<int>::iterator it;
-		bool allZeros = true;
-		for (it = wf.begin(); it != wf.end(); it++)
-		{
-			if ((*it) != 0)
-				allZeros = false;
-		}
-		if (allZeros)
-			return 1;
-	}
-
-	// the only remaining cases are where the field to be removed
-	// is currently 0, but other fields are populated with non-zero
-	// values. The field to be removed could be:
-	//	a) before the first non-zero field
-	//	b) after the last non-zero field
-	//	c) between two non-zero fields
-
-	unsigned int asPos = 0, wfPos = 0;
-	int knownWFVal;
-	unsigned int start = 0;
-	bool look = true;
-	while (look)
-	{
-		if (findPosMatchedVals(start, as, wf, knownWFVal, asPos, wfPos))
-		{
-			// if the positions are the same, then our field to be 
-			// removed must be after. try looking again
-			if (asPos == wfPos)
-			{
-				if (asPos == as.size())
-				{
-					// we're at the end, better remove next wf field
-					look = false;
-					return wfPos+1;
-				}
-				// otherwise, try next position
-				start = asPos;
-				continue;
-			}
-			else if (wfPos > asPos)
-			{
-				// wfPos greater means there must be a zero right
-				// before wfPos that can be removed
-				if (wf[wfPos-2] == 0)
-				{
-					look = false;
-					return wfPos-1;
-				}
-				// otherwise, try next position
-				start = asPos;
-				continue;
-			}
-		}
-		look = false;
-		if (start > 0)
-		{
-			// this means wfPos is now on the last known good
-			// position, we we can remove the next position, which
-			// must be a 0
-			if (wf[wfPos] == 0)
-				return wfPos+1;
-		}
-	}
-
-	return -1;
-}
-
-// do the delete (translate 1-based idx as needed)
-void
-delPos(int pos, vector<int> &vec)
-{
-	printf("delPos remove element #%d\n", pos);
-	int curr = 1;
-	vector<int>::iterator it;
-	for (it = vec.begin(); it != vec.end(); it++)
-	{
-		if (pos == curr)
-		{
-			vec.erase(it);
-			break;
-		}
-		curr++;
-	}
-}
-
-// insert a 0 value (translate 1-based idx as needed)
-void
-insPos(int pos, vector<int> &vec)
-{
-	if (pos == (int)vec.size())
-		vec.push_back(0);
-	else
-	{
-		int curr = 0;
-		vector<int>::iterator it;
-		for (it = vec.begin(); it != vec.end(); it++)
-		{
-			if (pos == curr)
-			{
-				vec.insert(it, 0);
-				break;
-			}
-			curr++;
-		}
-	}
-}
-
-//---------------------------------------------------------------
-// the logic to reconcile the vectors, including
-// lots of debug printing
-//---------------------------------------------------------------
-void fixVectors(vector<int> &a, vector<int> &w)
-{
-	printf("===========================================\n");
-	bool match = fldNumListsMatch(a, w);
-	printf("fldNumListsMatch returned %s\n"
-			, (match ? "true" : "false"));
-	logVecs(a, w);
-	if (match)
-	{
-		return;
-	}
-	// if actual (w) has labeled fields that aren't listed in
-	// config (a), then we should delete them.
-	vector<int> possibles;
-	findPossibles(possibles, w, a);
-	while (possibles.size())
-	{
-		logPossibles(possibles, "In Actual, not config");
-		for (unsigned int i = 0; i < w.size(); i++)
-		{
-			if (w[i] == possibles[0])
-			{
-				delPos(i+1, w);
-				break;
-			}
-		}
-		findPossibles(possibles, w, a);
-		logPossibles(possibles, "Now, in Actual, not config");
-	}
-
-	if (fldNumListsMatch(a, w))	// new
-	{
-		logVecs(a, w);
-		printf("OK, were done!\n");
-	}
-	else
-	{
-		int pos = 0;
-		// make sure things in a not in w have corresponding
-		// zeros
-		while (fixingW(a, w, pos))	// new
-		{
-			if (pos >= 0)
-				insPos(pos, w);
-			else	// pos < 0
-				delPos(0-pos, w);
-			logVecs(a, w);
-		}
-		// remove any extra zeros
-		while (w.size() > a.size())
-		{
-			pos = removeZeros(a, w);
-			if (pos > 0)
-			{
-				delPos(pos, w);
-				logVecs(a, w);
-			}
-			else
-				break;
-		}
-		if (!fldNumListsMatch(a, w))
-		{
-			logVecs(a, w);
-			printf("ERROR: vectors out of sync\n");
-			FailCount++;
-		}
-		else
-			printf("OK, were done!\n");
-	}
-}
-
-//---------------------------------------------------------------
-// main test program
-//---------------------------------------------------------------
-int
-main()
-{
-	printf("hello w\n");
-	vector<int> asVec;
-	vector<int> wfVec;
-
-	loadVec(asVec, "1,2,3");
-	loadVec(wfVec, "1,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,3");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "1,3");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "5,10,15,20");
-	loadVec(wfVec, "0,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,10,15");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "10,15");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,15");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,6,10");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,10,15,20,25");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,0,0,20,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,0,0,0,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,10,15,0,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,0,0,0,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,0,0,0,40");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,0,0,40");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "5,10,15,20");
-	loadVec(wfVec, "5,6,15");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "1,5,10,15,20");
-	loadVec(wfVec, "5,6,15,17");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "15,20");
-	loadVec(wfVec, "5,6,15,17,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "15,20");
-	loadVec(wfVec, "0,6,0,17,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "1,5,10,15,17,18");
-	loadVec(wfVec, "1,5,10,15,17,18");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "1,5,11,15,17,18");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "1,5,0,15,17,18");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,0,0,15,17,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "18");
-	loadVec(wfVec, "0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "");
-	loadVec(wfVec, "");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "5,10,15,16,20,25");
-	loadVec(wfVec, "10,15,20,25");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,15,20,25");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "5,10,15,16,20,25");
-	loadVec(wfVec, "0,5,10,15,16,20,25");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "5,10,15,16,20,25");
-	loadVec(wfVec, "0,5,10,15,16,20,25,29");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "5,10,15,0,0,16,20,25");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,0,5,10,15,16,20,25,29");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,5,10,16,20,0,25");
-	fixVectors(asVec, wfVec);
-
-	loadVec(wfVec, "0,5,10,15,0,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "");
-	loadVec(wfVec, "0,5,0");
-	fixVectors(asVec, wfVec);
-
-	loadVec(asVec, "3,13,23");
-	loadVec(wfVec, "");
-	fixVectors(asVec, wfVec);
-
-	if (FailCount)
-		printf("%d test(s) FAILED\n", FailCount);
-	return 0;
-}
+//---------------------------------------------------------------
+// Two vectors of integers. One represents a specification
+// or configuration of data records that must be captured.
+// Each record is identified by a non-zero integer, so the
+// specification vector may look like:
+//	{ 1, 4, 8, 9 } meaning that 4 data records must be
+// captured, and they'll be identified #1, #4, #8 and #9.
+// The numbers will always be in ascending order, but don't
+// have to be contiguous.
+//
+// The second vector represents a file in which data is being
+// captured. Since the specification vector indicates 4
+// records must be captured, the second vector starts out
+// with 4 zeros: { 0, 0, 0, 0 }. As data capture proceeds,
+// these "empty" records are replaced with the corresponding
+// specification numbers, so the second vector should end
+// up identical to the first: { 1, 4, 8, 9 }.
+//
+// One wrinkle is that we may get the second vector in an
+// intermediate state, where some or all of the entries are
+// still the initial zero value, e.g.: { 1, 0, 0, 9 }.
+//
+// The problem is, if the specification vector changes
+// (elements may be added or deleted, but will remain in
+// ascending order), how to bring the second vector in sync,
+// since some of the elements may still have the initial
+// zero values?
+//
+// Example:
+// The original specification vector was { 1, 4, 8, 9 }.
+// A file vector is created with initial zeros { 0, 0, 0, 0 };
+// One record gets populated with the identifying number:
+// { 0, 0, 8, 0 }.
+// Now, the specification changes. 4 is removed and 10 is added
+// to the end: { 1, 8, 9, 10 }. 
+// We have to remove the entry in the file vector that corresponds
+// to the entry removed from the specification vector, and we 
+// have to add a zero-filled entry in the position where 
+// new specification entry was added. 
+// We are given the new state of the specification vector and
+// the current state of the file vector:
+// Spec = { 1, 8, 9, 10 }
+// File = { 0, 0, 8, 0 }
+//---------------------------------------------------------------
+#include <vector>
+#include <array>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <string>
+#include <map>
+#include <set>
+#include <list>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <condition_variable>
+#include <coroutine>
+#include <type_traits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
+using namespace std;
+
+//---------------------------------------------------------------
+// globals
+//---------------------------------------------------------------
+atomic<int> FailCount(0);
+
+// the reconcile functions print their working as they go, which is
+// what the test program wants. worker threads and server modes
+// clear this for themselves.
+thread_local bool DebugLog = true;
+
+struct NotFoundSeq {
+	int start;
+	int end;
+};
+
+// sparse skip table over the captured (non-zero) entries of a
+// file vector. captured ids are ascending, so an anchor value can
+// be found by galloping over this table instead of scanning every
+// slot (zeros included). if the captured ids turn out not to be
+// strictly ascending, sorted is false and lookups fall back to
+// plain scans of w.
+struct AnchorIndex {
+	vector<unsigned int> nzPos;	// 0-based positions of non-zeros
+	bool sorted;
+};
+
+//---------------------------------------------------------------
+// forward declarations
+//---------------------------------------------------------------
+template <class W> int removeZeros(vector<int> &as, W &wf);
+bool writeFull(int fd, const void *buf, size_t len);
+bool readFull(int fd, void *buf, size_t len);
+template <class V> uint64_t hashSpec(const V &a);
+
+//---------------------------------------------------------------
+// utility functions
+//---------------------------------------------------------------
+// make it easier to initialize vectors in one line
+// in test program
+void
+loadVec(vector<int> &vec, const string &s)
+{
+	vec.clear();
+	string eat = s;
+	string part;
+	while (eat.length())
+	{
+		size_t pos = eat.find(",");
+		if (pos != string::npos)
+		{
+			part = eat.substr(0, pos);
+			eat = eat.substr(pos+1);
+		}
+		else
+		{
+			part = eat;
+			eat = "";
+		}
+		vec.push_back(atoi(part.c_str()));
+	}
+}
+
+// debug logging
+template <class W>
+void
+logVecs(vector<int> &asFields, W &wfFields)
+{
+	if (!DebugLog)
+		return;
+
+	unsigned int max = asFields.size();
+	if (wfFields.size() > max)
+		max = wfFields.size();
+
+	string line = "   Config         Actual \n";
+	for (unsigned int i = 0; i < max; i++)
+	{
+		char buf[8];
+		if (asFields.size() > i)
+		{
+			sprintf(buf, "     %d", asFields[i]);
+			line += buf;
+			if (strlen(buf) == 6)
+				line += " ";
+		}
+		else
+			line += "       ";
+		line += "            ";
+		if (wfFields.size() > i)
+		{
+			sprintf(buf, "%d", wfFields[i]);
+			line += buf;
+		}
+		line += "\n";
+	}
+	printf("%s", line.c_str());
+}
+
+uint64_t
+nowNs()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// debug logging
+void
+logPossibles(vector<int> const &possibles, const char *text)
+{
+	if (!DebugLog)
+		return;
+
+	string log = text;
+	log += ": ";
+	vector<int>::const_iterator it;
+	for (it = possibles.begin(); it != possibles.end(); it++)
+	{   
+		char buf[8];
+		sprintf(buf, "%d", (*it));
+		log += buf;
+		log += ", ";
+	}
+	log += "\n";
+	printf("%s", log.c_str());
+}
+
+//---------------------------------------------------------------
+// scanning primitives
+// the helpers spend most of their time scanning runs of slots for
+// zeros, non-zeros or one particular id. these do that a vector
+// register at a time, picking the widest instruction set the cpu
+// has when the program starts. everything goes through Scan.
+//
+// all of them take a plain pointer and length; from/returned
+// indexes are 0-based, and "not found" is n.
+//---------------------------------------------------------------
+struct ScanOps {
+	const char *name;
+	size_t (*nextNonZero)(const int *p, size_t n, size_t from);
+	size_t (*countZeros)(const int *p, size_t n);
+	bool (*allZeros)(const int *p, size_t n);
+	size_t (*findValue)(const int *p, size_t n, size_t from, int val);
+};
+
+size_t
+scalarNextNonZero(const int *p, size_t n, size_t from)
+{
+	for (size_t i = from; i < n; i++)
+	{
+		if (p[i] != 0)
+			return i;
+	}
+	return n;
+}
+
+size_t
+scalarCountZeros(const int *p, size_t n)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (p[i] == 0)
+			count++;
+	}
+	return count;
+}
+
+bool
+scalarAllZeros(const int *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if (p[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+size_t
+scalarFindValue(const int *p, size_t n, size_t from, int val)
+{
+	for (size_t i = from; i < n; i++)
+	{
+		if (p[i] == val)
+			return i;
+	}
+	return n;
+}
+
+const ScanOps ScalarScan = {
+	"scalar", scalarNextNonZero, scalarCountZeros, scalarAllZeros
+	, scalarFindValue
+};
+
+#if defined(__x86_64__)
+// sse2 is always there on x86-64, avx2 has to be asked for
+size_t
+sse2NextNonZero(const int *p, size_t n, size_t from)
+{
+	// dense files: the very next slot is usually the answer
+	if (from < n && p[from] != 0)
+		return from;
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = from;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero)));
+		if (mask != 0xf)
+			return i + __builtin_ctz(~mask & 0xf);
+	}
+	return scalarNextNonZero(p, n, i);
+}
+
+size_t
+sse2CountZeros(const int *p, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(v, zero));
+	}
+	int lanes[4];
+	_mm_storeu_si128((__m128i *)lanes, acc);
+	return (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3]
+			+ scalarCountZeros(p + i, n - i);
+}
+
+bool
+sse2AllZeros(const int *p, size_t n)
+{
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i v = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i))
+				, _mm_loadu_si128((const __m128i *)(p + i + 4)))
+			, _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i + 8))
+				, _mm_loadu_si128((const __m128i *)(p + i + 12))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xffff)
+			return false;
+	}
+	return scalarAllZeros(p + i, n - i);
+}
+
+size_t
+sse2FindValue(const int *p, size_t n, size_t from, int val)
+{
+	const __m128i want = _mm_set1_epi32(val);
+	size_t i = from;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, want)));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return scalarFindValue(p, n, i, val);
+}
+
+const ScanOps Sse2Scan = {
+	"sse2", sse2NextNonZero, sse2CountZeros, sse2AllZeros, sse2FindValue
+};
+
+__attribute__((target("avx2"))) size_t
+avx2NextNonZero(const int *p, size_t n, size_t from)
+{
+	// dense files: the very next slot is usually the answer
+	if (from < n && p[from] != 0)
+		return from;
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = from;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_cmpeq_epi32(v, zero)));
+		if (mask != 0xff)
+			return i + __builtin_ctz(~mask & 0xff);
+	}
+	return scalarNextNonZero(p, n, i);
+}
+
+__attribute__((target("avx2"))) size_t
+avx2CountZeros(const int *p, size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(v, zero));
+	}
+	int lanes[8];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	size_t count = 0;
+	for (int k = 0; k < 8; k++)
+		count += lanes[k];
+	return count + scalarCountZeros(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) bool
+avx2AllZeros(const int *p, size_t n)
+{
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32)
+	{
+		__m256i v = _mm256_or_si256(
+			_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i))
+				, _mm256_loadu_si256((const __m256i *)(p + i + 8)))
+			, _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i + 16))
+				, _mm256_loadu_si256((const __m256i *)(p + i + 24))));
+		if (!_mm256_testz_si256(v, v))
+			return false;
+	}
+	return scalarAllZeros(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) size_t
+avx2FindValue(const int *p, size_t n, size_t from, int val)
+{
+	const __m256i want = _mm256_set1_epi32(val);
+	size_t i = from;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_cmpeq_epi32(v, want)));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return scalarFindValue(p, n, i, val);
+}
+
+const ScanOps Avx2Scan = {
+	"avx2", avx2NextNonZero, avx2CountZeros, avx2AllZeros, avx2FindValue
+};
+#endif
+
+// every implementation this cpu can run, best last
+vector<const ScanOps *>
+availableScanOps()
+{
+	vector<const ScanOps *> ops(1, &ScalarScan);
+#if defined(__x86_64__)
+	ops.push_back(&Sse2Scan);
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		ops.push_back(&Avx2Scan);
+#endif
+	return ops;
+}
+
+const ScanOps *Scan = availableScanOps().back();
+
+// the first slot where w has a captured id that isn't a's, or n.
+// this one isn't dispatched through Scan: sse2 is always there on
+// x86-64, so it can be inlined into the callers that check sync
+// on every call.
+inline size_t
+firstOutOfSync(const int *a, const int *w, size_t n)
+{
+	size_t i = 0;
+#if defined(__x86_64__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i w0 = _mm_loadu_si128((const __m128i *)(w + i));
+		__m128i w1 = _mm_loadu_si128((const __m128i *)(w + i + 4));
+		__m128i ok0 = _mm_or_si128(_mm_cmpeq_epi32(w0, zero)
+			, _mm_cmpeq_epi32(w0, _mm_loadu_si128((const __m128i *)(a + i))));
+		__m128i ok1 = _mm_or_si128(_mm_cmpeq_epi32(w1, zero)
+			, _mm_cmpeq_epi32(w1, _mm_loadu_si128((const __m128i *)(a + i + 4))));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(ok0))
+			| (_mm_movemask_ps(_mm_castsi128_ps(ok1)) << 4);
+		if (mask != 0xff)
+			return i + __builtin_ctz(~mask & 0xff);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		if (w[i] != 0 && w[i] != a[i])
+			return i;
+	}
+	return n;
+}
+
+template <class W>
+bool
+fldNumListsMatch(const vector<int> &as, const W &wf)
+{
+	if (as.size() != wf.size())
+		return false;
+	return firstOutOfSync(as.data(), wf.data(), as.size()) == as.size();
+}
+
+// what it takes to bring w in sync with a. SYNC_AFTER_SIZE_FIX
+// means every captured id is already where a has it and only the
+// tail is wrong: w is short (pad with zeros) or has nothing but
+// zeros past the end of a (cut them off).
+enum SyncState {
+	SYNC_OK,
+	SYNC_AFTER_SIZE_FIX,
+	NEEDS_RECONCILE
+};
+
+template <class W>
+inline SyncState
+validateSync(const vector<int> &a, const W &w)
+{
+	size_t n = min(a.size(), w.size());
+	if (firstOutOfSync(a.data(), w.data(), n) != n)
+		return NEEDS_RECONCILE;
+	if (a.size() == w.size())
+		return SYNC_OK;
+	if (w.size() > a.size()
+			&& !Scan->allZeros(w.data() + n, w.size() - n))
+		return NEEDS_RECONCILE;
+	return SYNC_AFTER_SIZE_FIX;
+}
+
+template <class W>
+void
+buildAnchorIndex(AnchorIndex &ai, const W &w)
+{
+	ai.nzPos.clear();
+	ai.sorted = true;
+	int last = 0;
+	const int *p = w.data();
+	ai.nzPos.reserve(w.size() - Scan->countZeros(p, w.size()));
+	for (size_t i = 0; i < w.size(); i++)
+	{
+		// only call out to skip a run of zeros
+		if (p[i] == 0)
+		{
+			i = Scan->nextNonZero(p, w.size(), i);
+			if (i == w.size())
+				break;
+		}
+		if (w[i] <= last)
+			ai.sorted = false;
+		last = w[i];
+		ai.nzPos.push_back(i);
+	}
+}
+
+// first k >= from with w[nzPos[k]] >= val. steps out 1, 2, 4, ...
+// from 'from' and then binary searches the last step, so a query
+// costs O(log distance) rather than O(m).
+template <class W>
+unsigned int
+gallopAnchor(const AnchorIndex &ai, const W &w, int val
+		, unsigned int from)
+{
+	unsigned int n = ai.nzPos.size();
+	unsigned int lo = from;
+	unsigned int hi = from;
+	unsigned int step = 1;
+	while (hi < n && w[ai.nzPos[hi]] < val)
+	{
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
+	}
+	if (hi > n)
+		hi = n;
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (w[ai.nzPos[mid]] < val)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// find val in w and return its 1-based position, or 0 if it isn't
+// there. hint is where to start galloping and is moved up to the
+// answer, so a run of ascending queries walks the table only once.
+// fromEnd only matters for the unsorted fallback: it picks the
+// last occurrence instead of the first, like the scans it replaces.
+template <class W>
+int
+findAnchor(const AnchorIndex &ai, const W &w, int val
+		, unsigned int &hint, bool fromEnd)
+{
+	if (!ai.sorted)
+	{
+		int found = 0;
+		const int *p = w.data();
+		for (size_t i = Scan->findValue(p, w.size(), 0, val); i < w.size()
+				; i = Scan->findValue(p, w.size(), i+1, val))
+		{
+			found = i+1;
+			if (!fromEnd)
+				break;
+		}
+		return found;
+	}
+	unsigned int k = gallopAnchor(ai, w, val, hint);
+	hint = k;
+	if (k < ai.nzPos.size() && w[ai.nzPos[k]] == val)
+		return ai.nzPos[k] + 1;
+	return 0;
+}
+
+template <class W>
+void
+makeNotFoundVector(vector<NotFoundSeq> &nfsVec, vector<int> &a, W &w
+		, const AnchorIndex &ai)
+{
+	// scan the a vector. for each element, look it up in the
+	// w vector and count whether it is found or not. a is
+	// ascending, so each lookup gallops on from the last one.
+	vector<int>::iterator aIt;
+	unsigned int hint = 0;
+	int pos = 1;
+	int seqStart = 0;
+	int seqEnd = 0;
+
+	// nothing captured yet: all of a is one not-found sequence
+	if (ai.nzPos.empty())
+	{
+		if (a.size())
+		{
+			NotFoundSeq nfs;
+			nfs.start = 1;
+			nfs.end = a.size();
+			nfsVec.push_back(nfs);
+		}
+		return;
+	}
+	for (aIt = a.begin(); aIt != a.end(); aIt++)
+	{
+		bool found = (findAnchor(ai, w, (*aIt), hint, false) != 0);
+		if (found)
+		{
+			// if we have a sequence of not found, store it in vector
+			if (seqStart)
+			{
+				NotFoundSeq nfs;
+				nfs.start = seqStart;
+				nfs.end = seqEnd;
+				nfsVec.push_back(nfs);
+				seqStart = 0;
+				seqEnd = 0;
+			}
+		}
+		else
+		{
+			if (!seqStart)
+				seqStart = pos;
+			seqEnd = pos;
+		}
+		pos++;
+	}
+	// if we have an unfinished sequence of not found, store it in vector
+	if (seqStart)
+	{
+		NotFoundSeq nfs;
+		nfs.start = seqStart;
+		nfs.end = pos-1;;
+		nfsVec.push_back(nfs);
+		seqStart = 0;
+		seqEnd = 0;
+	}
+}
+
+void
+logNotFoundVector(vector<NotFoundSeq> &nfsVec)
+{
+	if (!DebugLog)
+		return;
+
+	string str = "nfsVec:\n";
+	vector<NotFoundSeq>::iterator nfsIt;
+	for (nfsIt = nfsVec.begin(); nfsIt != nfsVec.end(); nfsIt++)
+	{
+		str += "sequence start=";
+		char buf[8];
+		sprintf(buf, "%d", (*nfsIt).start);
+		str += buf;
+		str += ", end=";
+		sprintf(buf, "%d", (*nfsIt).end);
+		str += buf;
+		str += "\n";
+	}
+	printf("%s", str.c_str());
+}
+
+// call this after any non-zero values in w that aren't in a
+// have already been removed. this function figures out what elements
+// in a don't appear in w, and makes sure that there are corresponding
+// 0s in w in the right positions for those missing elements from a.
+//
+// it does this by making a list of sequences of a values that aren't
+// found in w.
+// each sequence is either:
+// i) starting at position 1
+// ii) ending at end of vector a (not exclusive of i)
+// iii) sandwiched between found elements
+//
+// if (i) then vector w must begin with a sequence of 0's
+//  as long as the not-found sequence.
+// if (ii) then vector w must end with a sequence of 0's
+//  as long as the not-found sequence.
+// if (iii) then there are found positions before and
+//  after the sequence. the distance between them in
+//  vector w must be the same as the distance
+//  between them in vector a.
+//
+// set pos to 0 to prepend at beginning of w vector
+// set pos to N to insert after pos N in w vector
+// set pos to -N to delete from position N in w vector
+template <class W>
+bool
+fixingW(vector<int> &a, W &w, int &pos)
+{
+	if (fldNumListsMatch(a, w))
+		return false;
+	if (w.size() == 0 && a.size() > 0)
+	{
+		pos = 0;
+		return true;
+	}
+
+	vector<NotFoundSeq> nfsVec;
+	AnchorIndex ai;
+
+	buildAnchorIndex(ai, w);
+	makeNotFoundVector(nfsVec, a, w, ai);
+
+	if (DebugLog)
+		printf("fixingW, a size=%u, w size=%u, nfsVec.size=%u\n"
+				, a.size(), w.size(), nfsVec.size());
+
+	if (nfsVec.size() == 0)
+		return false;
+
+	logNotFoundVector(nfsVec);
+	vector<NotFoundSeq>::iterator nfsIt;
+
+	int beforePosA = 0;
+	int afterPosA = 0;
+	int beforeVal = 0;
+	int afterVal = 0;
+	int beforePosW = 0;
+	int afterPosW = 0;
+	for (nfsIt = nfsVec.begin(); nfsIt != nfsVec.end(); nfsIt++)
+	{
+		if ((*nfsIt).start == 1)
+		{
+			// special case for all zeros in w
+			if ((*nfsIt).end == (int)a.size())
+			{
+				if (a.size() == w.size())
+					return false;
+				else if (w.size() < a.size())
+				{
+					pos = 0;
+					return true;
+				}
+				else	// w.size() > a.size()
+				{
+					pos = -1;
+					return true;
+				}
+			}
+			// case i)
+			afterPosA = (*nfsIt).end+1;
+			afterVal = a[afterPosA-1];
+			unsigned int hint = 0;
+			afterPosW = findAnchor(ai, w, afterVal, hint, false);
+			if (afterPosW == afterPosA)
+				continue;
+			else if (afterPosW < afterPosA)
+			{
+				// too few 0s at beginning
+				pos = 0;
+				return true;
+			}
+			else	// afterPosW > afterPosA
+			{
+				// too many 0s at beginning
+				pos = -1;
+				return true;
+			}
+		}
+		else if ((*nfsIt).end == (int)a.size())
+		{
+			// case ii)
+			beforePosA = (*nfsIt).start-1;
+			beforeVal = a[beforePosA-1];
+			unsigned int hint = 0;
+			beforePosW = findAnchor(ai, w, beforeVal, hint, true);
+			int fromEndA = a.size() - beforePosA;
+			int fromEndW = w.size() - beforePosW;
+			if (fromEndA == fromEndW)
+				continue;
+			else if (fromEndA < fromEndW)
+			{
+				// too many 0s at end
+				pos = (0 - w.size());
+				return true;
+			}
+			else	// fromEndA > fromEndW
+			{
+				// too few 0s at end
+				pos = w.size();
+				return true;
+			}
+		}
+		else
+		{
+			// case iii)
+			beforePosW = 0;
+			afterPosW = 0;
+			beforePosA = (*nfsIt).start-1;
+			beforeVal = a[beforePosA-1];
+			afterPosA = (*nfsIt).end+1;
+			afterVal = a[afterPosA-1];
+			unsigned int hint = 0;
+			beforePosW = findAnchor(ai, w, beforeVal, hint, true);
+			afterPosW = findAnchor(ai, w, afterVal, hint, true);
+			int aLen = afterPosA - beforePosA;
+			int wLen = afterPosW - beforePosW;
+			if (aLen == wLen)
+				continue;
+			else if (aLen < wLen)
+			{
+				// there are too many 0s
+				pos = 0 - (beforePosW+1);
+				return true;
+			}
+			else	// aLen > wLen
+			{
+				// there are too few 0s
+				pos = (beforePosW);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// make a list of everything in the suspect vector that
+// is not represented in the reference vector
+template <class W>
+void
+findPossibles(vector<int> &possibles, const W &suspect
+		, const vector<int> &reference)
+{
+	possibles.clear();
+	for (unsigned int i = 0; i < suspect.size(); i++)
+	{
+		int search = suspect[i];
+		if (search == 0)
+			continue;
+		bool found = Scan->findValue(reference.data(), reference.size()
+				, 0, search) < reference.size();
+		if (!found)
+			possibles.push_back(search);
+	}
+}
+
+// true if every id captured in w is still in a, which is when
+// fixVectors can skip its deletion phase. each id is looked up by
+// binary search, since a is ascending. (if it isn't, an id can be
+// missed, and the deletion phase just runs when it didn't need to.)
+template <class W>
+bool
+capturedAllInSpec(const vector<int> &a, const W &w)
+{
+	const int *p = w.data();
+	const size_t n = w.size();
+	for (size_t i = Scan->nextNonZero(p, n, 0); i < n
+			; i = Scan->nextNonZero(p, n, i+1))
+	{
+		if (!binary_search(a.begin(), a.end(), p[i]))
+			return false;
+	}
+	return true;
+}
+
+// scan forward through wf vector looking for the first non-zero
+// value after 'start' pos, and record its index. then find the 
+// matching value in the as vector, and record its index.
+// with a sorted anchor index both lookups are binary searches:
+// the skip table jumps straight over zero runs in wf, and as is
+// always ascending.
+template <class W>
+bool
+findPosMatchedVals(unsigned int start, vector<int> &as, W &wf
+		, const AnchorIndex &ai
+		, int &matchedVal, unsigned int &asPos, unsigned int &wfPos)
+{
+	bool changed = false;
+	unsigned int savedASPos = asPos;
+	unsigned int savedWFPos = wfPos;
+	if (ai.sorted)
+	{
+		vector<unsigned int>::const_iterator nz;
+		nz = lower_bound(ai.nzPos.begin(), ai.nzPos.end(), start);
+		if (nz == ai.nzPos.end() || start > as.size())
+			return false;
+		matchedVal = wf[*nz];
+		wfPos = (*nz)+1;
+		vector<int>::iterator it;
+		it = lower_bound(as.begin() + start, as.end(), matchedVal);
+		if (it != as.end() && (*it) == matchedVal)
+		{
+			asPos = (it - as.begin())+1;
+			changed = true;
+		}
+	}
+	else
+	{
+		size_t i = Scan->nextNonZero(wf.data(), wf.size(), start);
+		if (i < wf.size())
+		{
+			matchedVal = wf[i];
+			wfPos = i+1;
+		}
+		if (start < as.size())
+		{
+			i = Scan->findValue(as.data(), as.size(), start, matchedVal);
+			if (i < as.size())
+			{
+				asPos = i+1;
+				changed = true;
+			}
+		}
+	}
+	if (!changed)
+	{
+		wfPos = savedWFPos;
+		asPos = savedASPos;
+	}
+	return (changed);
+}
+
+template <class W>
+int
+removeZeros(vector<int> &as, W &wf)
+{
+	// if wf vector is all 0s, we can just return the
+	// first position
+	if (wf.size() > as.size() && Scan->allZeros(wf.data(), wf.size()))
+		return 1;
+
+	// the only remaining cases are where the field to be removed
+	// is currently 0, but other fields are populated with non-zero
+	// values. The field to be removed could be:
+	//	a) before the first non-zero field
+	//	b) after the last non-zero field
+	//	c) between two non-zero fields
+
+	unsigned int asPos = 0, wfPos = 0;
+	int knownWFVal = 0;
+	unsigned int start = 0;
+	bool look = true;
+	AnchorIndex ai;
+	buildAnchorIndex(ai, wf);
+	while (look)
+	{
+		if (findPosMatchedVals(start, as, wf, ai, knownWFVal, asPos, wfPos))
+		{
+			// if the positions are the same, then our field to be 
+			// removed must be after. try looking again
+			if (asPos == wfPos)
+			{
+				if (asPos == as.size())
+				{
+					// we're at the end, better remove next wf field
+					look = false;
+					return wfPos+1;
+				}
+				// otherwise, try next position
+				start = asPos;
+				continue;
+			}
+			else if (wfPos > asPos)
+			{
+				// wfPos greater means there must be a zero right
+				// before wfPos that can be removed
+				if (wf[wfPos-2] == 0)
+				{
+					look = false;
+					return wfPos-1;
+				}
+				// otherwise, try next position
+				start = asPos;
+				continue;
+			}
+		}
+		look = false;
+		if (start > 0)
+		{
+			// this means wfPos is now on the last known good
+			// position, we we can remove the next position, which
+			// must be a 0
+			if (wf[wfPos] == 0)
+				return wfPos+1;
+		}
+	}
+
+	return -1;
+}
+
+// do the delete (translate 1-based idx as needed)
+template <class W>
+void
+delPos(int pos, W &vec)
+{
+	if (DebugLog)
+		printf("delPos remove element #%d\n", pos);
+	int curr = 1;
+	typename W::iterator it;
+	for (it = vec.begin(); it != vec.end(); it++)
+	{
+		if (pos == curr)
+		{
+			vec.erase(it);
+			break;
+		}
+		curr++;
+	}
+}
+
+// insert a 0 value (translate 1-based idx as needed)
+template <class W>
+void
+insPos(int pos, W &vec)
+{
+	if (pos == (int)vec.size())
+		vec.push_back(0);
+	else
+	{
+		int curr = 0;
+		typename W::iterator it;
+		for (it = vec.begin(); it != vec.end(); it++)
+		{
+			if (pos == curr)
+			{
+				vec.insert(it, 0);
+				break;
+			}
+			curr++;
+		}
+	}
+}
+
+//---------------------------------------------------------------
+// reconcile statistics
+// with StatsEnabled set, every fixVectors call adds to a set of
+// histograms: how big the file vector was, how many slots it
+// inserted and deleted, how many bytes those shifted, and how long
+// each phase took. buckets are powers of two (bucket b counts
+// values whose bit length is b). every call is also counted by
+// outcome; the phase histograms only sample calls that ran the
+// phases (reconciled or failed), so files that were already in
+// sync don't pile up in their zero buckets.
+//
+// each thread records into its own StatBlock with plain loads and
+// stores (it's the only writer), so recording costs no locks and
+// no shared cache lines. snapshotStats adds up every block with
+// relaxed loads. a thread that exits folds its counts into
+// RetiredStats, as does any thread past MaxStatThreads, which
+// records there with atomic adds instead. a snapshot taken while a
+// thread is exiting can count its calls twice.
+//---------------------------------------------------------------
+enum {
+	STAT_SLOTS,
+	STAT_EDITS,
+	STAT_BYTES_MOVED,
+	STAT_DELETE_NS,
+	STAT_FIXINGW_NS,
+	STAT_REMOVEZEROS_NS,
+	STAT_KINDS
+};
+
+// in order of precedence: a call made of pieces takes the last one
+// any piece had
+enum {
+	OUTCOME_NOOP,		// already in sync
+	OUTCOME_RESIZED,	// in sync once zeros were added or trimmed
+	OUTCOME_RECONCILED,
+	OUTCOME_FAILED,
+	OUTCOME_KINDS
+};
+
+const unsigned int StatBuckets = 48;	// the last one takes anything bigger
+const unsigned int MaxStatThreads = 64;
+
+struct StatHist {
+	atomic<uint64_t> count;
+	atomic<uint64_t> sum;
+	atomic<uint64_t> buckets[StatBuckets];
+};
+
+struct StatBlock {
+	StatHist hist[STAT_KINDS];
+	atomic<uint64_t> outcomes[OUTCOME_KINDS];
+	atomic<bool> claimed;
+};
+
+StatBlock StatBlocks[MaxStatThreads];
+StatBlock RetiredStats;
+atomic<bool> StatsEnabled(false);
+
+// what one fixVectors call did
+struct CallStats {
+	uint64_t edits;
+	uint64_t moved;
+	uint64_t phaseNs[3];	// deletion, fixingW, removeZeros
+	bool timed;
+	unsigned int outcome;
+};
+
+// set while a thread reconciles one piece of a bigger call (see
+// fixVectorsParallel): fixVectors folds its counts in here instead of
+// recording them, and isn't captured for replay, so the bigger call
+// shows up once.
+thread_local CallStats *NestedCall = NULL;
+
+void
+statAdd(atomic<uint64_t> &c, uint64_t v, bool shared)
+{
+	if (shared)
+		c.fetch_add(v, memory_order_relaxed);
+	else
+		c.store(c.load(memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+void
+addToHist(StatHist &h, uint64_t v, bool shared)
+{
+	unsigned int b = v ? 64 - __builtin_clzll(v) : 0;
+	if (b >= StatBuckets)
+		b = StatBuckets - 1;
+	statAdd(h.count, 1, shared);
+	statAdd(h.sum, v, shared);
+	statAdd(h.buckets[b], 1, shared);
+}
+
+// move everything in b into RetiredStats
+void
+retireStatBlock(StatBlock &b)
+{
+	for (unsigned int k = 0; k < STAT_KINDS; k++)
+	{
+		StatHist &from = b.hist[k];
+		StatHist &to = RetiredStats.hist[k];
+		to.count.fetch_add(from.count.exchange(0, memory_order_relaxed)
+				, memory_order_relaxed);
+		to.sum.fetch_add(from.sum.exchange(0, memory_order_relaxed)
+				, memory_order_relaxed);
+		for (unsigned int i = 0; i < StatBuckets; i++)
+			to.buckets[i].fetch_add(from.buckets[i].exchange(0
+					, memory_order_relaxed), memory_order_relaxed);
+	}
+	for (unsigned int k = 0; k < OUTCOME_KINDS; k++)
+		RetiredStats.outcomes[k].fetch_add(b.outcomes[k].exchange(0
+				, memory_order_relaxed), memory_order_relaxed);
+}
+
+struct StatOwner {
+	StatBlock *block;
+	StatOwner() : block(NULL) {}
+	~StatOwner()
+	{
+		if (block && block != &RetiredStats)
+		{
+			retireStatBlock(*block);
+			block->claimed.store(false, memory_order_release);
+		}
+	}
+};
+
+thread_local StatOwner MyStats;
+
+StatBlock &
+myStatBlock()
+{
+	if (MyStats.block)
+		return *MyStats.block;
+	MyStats.block = &RetiredStats;
+	for (unsigned int i = 0; i < MaxStatThreads; i++)
+	{
+		bool expected = false;
+		if (StatBlocks[i].claimed.compare_exchange_strong(expected, true
+				, memory_order_acquire))
+		{
+			MyStats.block = &StatBlocks[i];
+			break;
+		}
+	}
+	return *MyStats.block;
+}
+
+// fold one piece of a call into the whole. the pieces ran side by
+// side, so the slowest one's phase times stand for the call.
+void
+addCallStats(CallStats &into, const CallStats &cs)
+{
+	into.edits += cs.edits;
+	into.moved += cs.moved;
+	for (unsigned int p = 0; p < 3; p++)
+		into.phaseNs[p] = max(into.phaseNs[p], cs.phaseNs[p]);
+	into.timed = into.timed || cs.timed;
+	into.outcome = max(into.outcome, cs.outcome);
+}
+
+void
+recordReconcileStats(size_t slots, const CallStats &cs)
+{
+	if (!StatsEnabled.load(memory_order_relaxed))
+		return;
+	if (NestedCall)
+	{
+		addCallStats(*NestedCall, cs);
+		return;
+	}
+	StatBlock &b = myStatBlock();
+	bool shared = (&b == &RetiredStats);
+	addToHist(b.hist[STAT_SLOTS], slots, shared);
+	addToHist(b.hist[STAT_EDITS], cs.edits, shared);
+	addToHist(b.hist[STAT_BYTES_MOVED], cs.moved, shared);
+	statAdd(b.outcomes[cs.outcome], 1, shared);
+	if (cs.timed && (cs.outcome == OUTCOME_RECONCILED
+			|| cs.outcome == OUTCOME_FAILED))
+	{
+		for (unsigned int p = 0; p < 3; p++)
+			addToHist(b.hist[STAT_DELETE_NS + p], cs.phaseNs[p], shared);
+	}
+}
+
+// count one insPos/delPos in fixingW's pos encoding, made on a
+// vector of size slots, and record it in script if there is one
+void
+noteEdit(CallStats &cs, vector<int> *script, int pos, size_t slots)
+{
+	cs.edits++;
+	// everything after the edited slot shifts by one
+	size_t at = (pos >= 0) ? pos : 0-pos;
+	cs.moved += (slots - min(at, slots)) * sizeof(int);
+	if (script)
+		script->push_back(pos);
+}
+
+struct StatsSnapshot {
+	struct {
+		uint64_t count;
+		uint64_t sum;
+		uint64_t buckets[StatBuckets];
+	} hist[STAT_KINDS];
+	uint64_t outcomes[OUTCOME_KINDS];
+};
+
+void
+addStatBlock(StatsSnapshot &s, StatBlock &b)
+{
+	for (unsigned int k = 0; k < STAT_KINDS; k++)
+	{
+		s.hist[k].count += b.hist[k].count.load(memory_order_relaxed);
+		s.hist[k].sum += b.hist[k].sum.load(memory_order_relaxed);
+		for (unsigned int i = 0; i < StatBuckets; i++)
+			s.hist[k].buckets[i] += b.hist[k].buckets[i].load(
+					memory_order_relaxed);
+	}
+	for (unsigned int k = 0; k < OUTCOME_KINDS; k++)
+		s.outcomes[k] += b.outcomes[k].load(memory_order_relaxed);
+}
+
+void
+snapshotStats(StatsSnapshot &s)
+{
+	memset(&s, 0, sizeof(s));
+	for (unsigned int i = 0; i < MaxStatThreads; i++)
+		addStatBlock(s, StatBlocks[i]);
+	addStatBlock(s, RetiredStats);
+}
+
+struct StatInfo {
+	const char *name;
+	const char *help;
+	double scale;	// bucket units to exported units
+};
+
+const StatInfo StatInfos[STAT_KINDS] = {
+	{ "seqmodify_reconcile_slots"
+		, "File vector slots per fixVectors call.", 1 },
+	{ "seqmodify_reconcile_edits"
+		, "Slots inserted and deleted per fixVectors call.", 1 },
+	{ "seqmodify_reconcile_bytes_moved"
+		, "Bytes shifted by inserts and deletes per fixVectors call.", 1 },
+	{ "seqmodify_delete_phase_seconds"
+		, "Time spent dropping ids the spec no longer has.", 1e-9 },
+	{ "seqmodify_fixingw_phase_seconds"
+		, "Time spent lining up zeros for missing ids (fixingW).", 1e-9 },
+	{ "seqmodify_removezeros_phase_seconds"
+		, "Time spent removing extra zeros (removeZeros).", 1e-9 },
+};
+
+const char *OutcomeNames[OUTCOME_KINDS] = {
+	"noop", "resized", "reconciled", "failed"
+};
+
+// the snapshot in prometheus text exposition format
+void
+formatStatsPrometheus(const StatsSnapshot &s, string &out)
+{
+	char line[256];
+	out.clear();
+	for (unsigned int k = 0; k < STAT_KINDS; k++)
+	{
+		const StatInfo &info = StatInfos[k];
+		snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n"
+				, info.name, info.help, info.name);
+		out += line;
+		unsigned int top = 0;
+		for (unsigned int i = 0; i < StatBuckets - 1; i++)
+			if (s.hist[k].buckets[i])
+				top = i;
+		uint64_t cumulative = 0;
+		for (unsigned int i = 0; i <= top; i++)
+		{
+			cumulative += s.hist[k].buckets[i];
+			snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n"
+					, info.name, ((1ULL << i) - 1) * info.scale
+					, (unsigned long long)cumulative);
+			out += line;
+		}
+		snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n"
+				"%s_sum %g\n%s_count %llu\n"
+				, info.name, (unsigned long long)s.hist[k].count
+				, info.name, s.hist[k].sum * info.scale
+				, info.name, (unsigned long long)s.hist[k].count);
+		out += line;
+	}
+	const char *calls = "seqmodify_reconcile_calls_total";
+	snprintf(line, sizeof(line), "# HELP %s fixVectors calls by outcome.\n"
+			"# TYPE %s counter\n", calls, calls);
+	out += line;
+	for (unsigned int k = 0; k < OUTCOME_KINDS; k++)
+	{
+		snprintf(line, sizeof(line), "%s{outcome=\"%s\"} %llu\n", calls
+				, OutcomeNames[k], (unsigned long long)s.outcomes[k]);
+		out += line;
+	}
+}
+
+// write the current stats to path for a node exporter's textfile
+// collector to pick up. it goes to a temporary file first and is
+// renamed into place, so a scrape never sees half of it.
+bool
+writeStatsFile(const char *path)
+{
+	StatsSnapshot s;
+	snapshotStats(s);
+	string text;
+	formatStatsPrometheus(s, text);
+	string tmp = string(path) + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool ok = writeFull(fd, text.data(), text.size());
+	ok = (close(fd) == 0) && ok;
+	return ok && rename(tmp.c_str(), path) == 0;
+}
+
+//---------------------------------------------------------------
+// slow call capture
+// startReplayCapture makes every fixVectors call that takes longer
+// than a threshold append its inputs to a replay file, so a slow
+// spec/file pair seen in production can be rerun offline
+// (seqmodify replay) under the benchmark harness. records are
+// native-endian, like the capture files:
+//	ReplayHeader, then the spec, then the file vector as it was
+//	passed in
+// the header keeps the options the call was made with, how long it
+// took and a hash of what it returned, so a replay can check it
+// still gets the same answer.
+//
+// the inputs are only copied while capture is on.
+//
+// while capture is on, guards count themselves in ReplayGuards
+// under the current ReplayPhase (the same handshake as
+// waitForFills), and stopReplayCapture waits for the guards that
+// might hold the capture before freeing it. calls made while
+// capture is off never touch the counts.
+//---------------------------------------------------------------
+const uint32_t ReplayMagic = 0x50524553;	// "SERP"
+
+enum {
+	REPLAY_SCRIPT = 1	// an edit script was asked for
+};
+
+struct ReplayHeader {
+	uint32_t magic;
+	uint32_t flags;
+	uint64_t elapsedNs;
+	uint64_t resultHash;	// hashSpec of the reconciled vector
+	uint32_t specLen;
+	uint32_t fileLen;
+};
+
+struct ReplayCapture {
+	int fd;
+	uint64_t thresholdNs;
+	mutex lock;
+	atomic<uint64_t> captured;
+};
+
+atomic<ReplayCapture *> SlowCapture(NULL);
+atomic<unsigned int> ReplayPhase(0);
+atomic<int> ReplayGuards[2];
+mutex ReplayStopLock;
+
+bool
+startReplayCapture(const char *path, uint64_t thresholdNs)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0)
+		return false;
+	ReplayCapture *rc = new ReplayCapture;
+	rc->fd = fd;
+	rc->thresholdNs = thresholdNs;
+	rc->captured = 0;
+	SlowCapture.store(rc, memory_order_release);
+	return true;
+}
+
+// stop capturing. waits for calls that may still be holding the
+// capture to write their records, but not for calls that start
+// after this does.
+uint64_t
+stopReplayCapture()
+{
+	lock_guard<mutex> lk(ReplayStopLock);
+	ReplayCapture *rc = SlowCapture.exchange(NULL);
+	if (!rc)
+		return 0;
+	unsigned int phase = ReplayPhase.fetch_xor(1);
+	while (ReplayGuards[phase].load())
+		this_thread::yield();
+	uint64_t captured = rc->captured;
+	close(rc->fd);
+	delete rc;
+	return captured;
+}
+
+void
+appendReplay(ReplayCapture &rc, const vector<int> &a, const vector<int> &w
+		, uint32_t flags, uint64_t elapsedNs, uint64_t resultHash)
+{
+	ReplayHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = ReplayMagic;
+	h.flags = flags;
+	h.elapsedNs = elapsedNs;
+	h.resultHash = resultHash;
+	h.specLen = a.size();
+	h.fileLen = w.size();
+	vector<char> rec((const char *)&h, (const char *)(&h + 1));
+	rec.insert(rec.end(), (const char *)a.data()
+			, (const char *)(a.data() + a.size()));
+	rec.insert(rec.end(), (const char *)w.data()
+			, (const char *)(w.data() + w.size()));
+	lock_guard<mutex> g(rc.lock);
+	if (writeFull(rc.fd, rec.data(), rec.size()))
+		rc.captured++;
+}
+
+// lives for one fixVectors call: remembers its inputs, and on the
+// way out writes them to the replay file if the call was slow
+template <class W>
+struct ReplayGuard {
+	ReplayCapture *rc;
+	const vector<int> &a;
+	const W &w;
+	vector<int> input;
+	uint32_t flags;
+	uint64_t start;
+	int phase;	// -1 = not counted
+
+	ReplayGuard(const vector<int> &spec, const W &file, uint32_t callFlags)
+		: rc(NULL), a(spec), w(file), flags(callFlags), start(0), phase(-1)
+	{
+		if (NestedCall || !SlowCapture.load(memory_order_relaxed))
+			return;
+		// count ourselves, then look again: a stop that flipped the
+		// phase before we were counted has already cleared it
+		for (;;)
+		{
+			unsigned int p = ReplayPhase.load();
+			ReplayGuards[p]++;
+			if (ReplayPhase.load() == p)
+			{
+				phase = p;
+				break;
+			}
+			ReplayGuards[p]--;
+		}
+		rc = SlowCapture.load();
+		if (!rc)
+			return;
+		input.assign(w.begin(), w.end());
+		start = nowNs();
+	}
+
+	~ReplayGuard()
+	{
+		if (rc)
+		{
+			uint64_t elapsed = nowNs() - start;
+			if (elapsed >= rc->thresholdNs)
+				appendReplay(*rc, a, input, flags, elapsed, hashSpec(w));
+		}
+		if (phase >= 0)
+			ReplayGuards[phase]--;
+	}
+};
+
+//---------------------------------------------------------------
+// the logic to reconcile the vectors, including
+// lots of debug printing
+//---------------------------------------------------------------
+// returns true if the vectors are in sync afterwards. if script is
+// given, every edit made to w is appended to it in fixingW's pos
+// encoding (N >= 0 inserts a 0 after slot N, -N deletes slot N),
+// so the same edits can be replayed later with applyEditScript.
+// w can be a vector<int> or a SmallFileVec.
+template <class W>
+bool fixVectors(vector<int> &a, W &w, vector<int> *script = NULL)
+{
+	ReplayGuard replay(a, w, script ? REPLAY_SCRIPT : 0);
+	CallStats cs;
+	memset(&cs, 0, sizeof(cs));
+	size_t slots = w.size();
+	SyncState state = validateSync(a, w);
+	if (state != NEEDS_RECONCILE)
+	{
+		if (DebugLog)
+			printf("validateSync: in sync%s\n"
+					, (state == SYNC_OK) ? "" : " after size fix");
+		while (w.size() < a.size())
+		{
+			noteEdit(cs, script, w.size(), w.size());
+			w.push_back(0);
+		}
+		while (w.size() > a.size())
+		{
+			noteEdit(cs, script, 0-(int)w.size(), w.size());
+			w.pop_back();
+		}
+		cs.outcome = cs.edits ? OUTCOME_RESIZED : OUTCOME_NOOP;
+		recordReconcileStats(slots, cs);
+		return true;
+	}
+	cs.timed = StatsEnabled.load(memory_order_relaxed);
+	uint64_t t0 = cs.timed ? nowNs() : 0;
+	// validateSync has already ruled out the vectors matching
+	if (DebugLog)
+		printf("===========================================\n");
+	logVecs(a, w);
+	cs.outcome = OUTCOME_RECONCILED;
+	// if actual (w) has labeled fields that aren't listed in
+	// config (a), then we should delete them. usually there aren't
+	// any, and that can be checked without findPossibles' scans.
+	vector<int> possibles;
+	if (!capturedAllInSpec(a, w))
+		findPossibles(possibles, w, a);
+	while (possibles.size())
+	{
+		logPossibles(possibles, "In Actual, not config");
+		for (unsigned int i = 0; i < w.size(); i++)
+		{
+			if (w[i] == possibles[0])
+			{
+				noteEdit(cs, script, 0-(int)(i+1), w.size());
+				delPos(i+1, w);
+				break;
+			}
+		}
+		findPossibles(possibles, w, a);
+		logPossibles(possibles, "Now, in Actual, not config");
+	}
+	uint64_t t1 = cs.timed ? nowNs() : 0;
+	uint64_t t2 = t1;
+	cs.phaseNs[0] = t1 - t0;
+
+	if (fldNumListsMatch(a, w))	// new
+	{
+		logVecs(a, w);
+		if (DebugLog)
+			printf("OK, were done!\n");
+	}
+	else
+	{
+		int pos = 0;
+		// make sure things in a not in w have corresponding
+		// zeros
+		while (fixingW(a, w, pos))	// new
+		{
+			noteEdit(cs, script, pos, w.size());
+			if (pos >= 0)
+				insPos(pos, w);
+			else	// pos < 0
+				delPos(0-pos, w);
+			logVecs(a, w);
+		}
+		t2 = cs.timed ? nowNs() : 0;
+		cs.phaseNs[1] = t2 - t1;
+		// remove any extra zeros
+		while (w.size() > a.size())
+		{
+			pos = removeZeros(a, w);
+			if (pos > 0)
+			{
+				noteEdit(cs, script, 0-pos, w.size());
+				delPos(pos, w);
+				logVecs(a, w);
+			}
+			else
+				break;
+		}
+		cs.phaseNs[2] = cs.timed ? nowNs() - t2 : 0;
+		if (!fldNumListsMatch(a, w))
+		{
+			logVecs(a, w);
+			printf("ERROR: vectors out of sync\n");
+			FailCount++;
+			cs.outcome = OUTCOME_FAILED;
+			recordReconcileStats(slots, cs);
+			return false;
+		}
+		else if (DebugLog)
+			printf("OK, were done!\n");
+	}
+	recordReconcileStats(slots, cs);
+	return true;
+}
+
+// replay edits recorded by fixVectors
+void
+applyEditScript(const vector<int> &script, vector<int> &w)
+{
+	for (unsigned int i = 0; i < script.size(); i++)
+	{
+		if (script[i] >= 0)
+			insPos(script[i], w);
+		else
+			delPos(0-script[i], w);
+	}
+}
+
+//---------------------------------------------------------------
+// small file vectors
+// most file vectors are only a few dozen slots long. a SmallVec
+// keeps up to N of them inline and only goes to the heap past
+// that, and inserting or deleting within the inline capacity
+// never allocates. it's only for trivially copyable T; elements
+// are moved with memmove.
+//
+// a SmallVec has the parts of vector's interface fixVectors uses,
+// so fixVectors on a SmallFileVec is the same algorithm, with the
+// same stats and replay capture, on a file vector that stays on
+// the stack.
+//---------------------------------------------------------------
+template <class T, unsigned int N>
+struct SmallVec {
+	static_assert(is_trivially_copyable<T>::value
+			, "SmallVec moves elements with memmove");
+
+	T *p;
+	size_t n;
+	size_t cap;
+	T inl[N];
+
+	typedef T *iterator;
+	typedef const T *const_iterator;
+
+	SmallVec() : p(inl), n(0), cap(N) {}
+	SmallVec(const SmallVec &o) : p(inl), n(0), cap(N)
+	{
+		assign(o.p, o.n);
+	}
+	SmallVec(SmallVec &&o) : p(inl), n(0), cap(N)
+	{
+		if (o.p == o.inl)
+			assign(o.p, o.n);
+		else
+		{
+			p = o.p;
+			n = o.n;
+			cap = o.cap;
+			o.p = o.inl;
+			o.n = 0;
+			o.cap = N;
+		}
+	}
+	~SmallVec()
+	{
+		if (p != inl)
+			free(p);
+	}
+	SmallVec &operator=(const SmallVec &o)
+	{
+		if (this != &o)
+			assign(o.p, o.n);
+		return *this;
+	}
+
+	size_t size() const { return n; }
+	bool onHeap() const { return p != inl; }
+	T *data() { return p; }
+	const T *data() const { return p; }
+	T *begin() { return p; }
+	T *end() { return p + n; }
+	const T *begin() const { return p; }
+	const T *end() const { return p + n; }
+	T &operator[](size_t i) { return p[i]; }
+	const T &operator[](size_t i) const { return p[i]; }
+
+	void reserve(size_t want)
+	{
+		if (want <= cap)
+			return;
+		size_t newCap = max(want, cap * 2);
+		T *q = (T *)malloc(newCap * sizeof(T));
+		if (!q)
+			abort();
+		memcpy(q, p, n * sizeof(T));
+		if (p != inl)
+			free(p);
+		p = q;
+		cap = newCap;
+	}
+	void assign(const T *src, size_t count)
+	{
+		n = 0;
+		reserve(count);
+		if (count)
+			memmove(p, src, count * sizeof(T));
+		n = count;
+	}
+	void resize(size_t count, T v = T())
+	{
+		reserve(count);
+		for (size_t i = n; i < count; i++)
+			p[i] = v;
+		n = count;
+	}
+	void push_back(T v)
+	{
+		reserve(n + 1);
+		p[n++] = v;
+	}
+	void pop_back()
+	{
+		n--;
+	}
+	T *insert(const T *pos, T v)
+	{
+		size_t at = pos - p;
+		reserve(n + 1);
+		memmove(p + at + 1, p + at, (n - at) * sizeof(T));
+		p[at] = v;
+		n++;
+		return p + at;
+	}
+	T *erase(const T *pos)
+	{
+		size_t at = pos - p;
+		memmove(p + at, p + at + 1, (n - at - 1) * sizeof(T));
+		n--;
+		return p + at;
+	}
+	bool operator==(const SmallVec &o) const
+	{
+		return n == o.n && memcmp(p, o.p, n * sizeof(T)) == 0;
+	}
+	bool operator!=(const SmallVec &o) const { return !(*this == o); }
+};
+
+const unsigned int SmallFileSlots = 32;
+typedef SmallVec<int, SmallFileSlots> SmallFileVec;
+
+//---------------------------------------------------------------
+// spec index
+// the preprocessed form of a specification vector. once a spec
+// is indexed, a file vector can be reconciled against it in a
+// single pass: every captured id is looked up in the index and
+// dropped into its spec position, and everything else becomes
+// a zero. this lands on the same result fixVectors does, without
+// the repeated scans.
+//---------------------------------------------------------------
+struct SpecIndex {
+	vector<int> spec;
+	uint64_t hash;				// hashSpec(spec)
+	unordered_map<int, unsigned int> posOf;	// id -> 0-based position
+};
+
+// fast content hash of a spec vector (FNV-1a over 32-bit words,
+// then a final avalanche so nearby specs spread across buckets)
+template <class V>
+uint64_t
+hashSpec(const V &a)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ a.size();
+	for (unsigned int i = 0; i < a.size(); i++)
+	{
+		h ^= (uint32_t)a[i];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+void
+buildSpecIndex(SpecIndex &si, const vector<int> &a)
+{
+	si.spec = a;
+	si.hash = hashSpec(a);
+	si.posOf.clear();
+	si.posOf.reserve(a.size());
+	for (unsigned int i = 0; i < a.size(); i++)
+		si.posOf[a[i]] = i;
+}
+
+// returns true if w had to be changed
+bool
+reconcileIndexed(const SpecIndex &si, vector<int> &w)
+{
+	SyncState state = validateSync(si.spec, w);
+	if (state == SYNC_OK)
+		return false;
+	if (state == SYNC_AFTER_SIZE_FIX)
+	{
+		w.resize(si.spec.size(), 0);
+		return true;
+	}
+	vector<int> out(si.spec.size(), 0);
+	for (unsigned int i = 0; i < w.size(); i++)
+	{
+		if (w[i] == 0)
+			continue;
+		unordered_map<int, unsigned int>::const_iterator it;
+		it = si.posOf.find(w[i]);
+		if (it != si.posOf.end())
+			out[it->second] = w[i];
+	}
+	if (out == w)
+		return false;
+	w.swap(out);
+	return true;
+}
+
+//---------------------------------------------------------------
+// minimum-edit reconciliation
+// fixVectors drops captured ids the spec no longer has, then
+// inserts and deletes zeros wherever fixingW first finds a gap of
+// the wrong size. the result is always the same, but the edits
+// that get there can shift far more slots than they need to.
+//
+// this mode lands on the same result with the cheapest edit script
+// under an EditCostModel. every slot of the old vector either
+// survives into the result or is deleted, and every slot of the
+// result is either a survivor or an inserted zero. a survivor that
+// ends up at a different offset than it started counts as moved.
+// captured ids the spec still has always survive, at the spec
+// position, so they cut both vectors into segments. within a
+// segment only zeros are left to choose about: which old zeros to
+// keep for which new ones. each segment is a small edit-distance
+// table, solved on its own.
+//---------------------------------------------------------------
+struct EditCostModel {
+	long insertZero;
+	long deleteZero;
+	long deleteCaptured;	// an id the spec no longer has
+	long moveSlot;		// a survivor at a new offset
+};
+
+// moving a slot means rewriting it on disk, and anything after it
+const EditCostModel DefaultEditCosts = { 1, 1, 1, 4 };
+
+// segments bigger than this many table cells keep their zeros in
+// order instead (what fixVectors does), so one huge run of zeros
+// can't blow up the time or memory
+const size_t MinEditMaxCells = 1 << 22;
+
+// what the edits in script cost, applied to w
+long
+editScriptCost(const vector<int> &w, const vector<int> &script
+		, const EditCostModel &cm)
+{
+	// track where each slot started; -1 for inserted zeros
+	vector<int> from(w.size());
+	for (unsigned int i = 0; i < w.size(); i++)
+		from[i] = i;
+	long cost = 0;
+	for (unsigned int s = 0; s < script.size(); s++)
+	{
+		if (script[s] >= 0)
+		{
+			from.insert(from.begin() + script[s], -1);
+			cost += cm.insertZero;
+			continue;
+		}
+		unsigned int at = 0-script[s]-1;
+		if (from[at] < 0)
+			cost += cm.deleteZero;	// it was only just inserted
+		else
+			cost += w[from[at]] ? cm.deleteCaptured : cm.deleteZero;
+		from.erase(from.begin() + at);
+	}
+	for (unsigned int i = 0; i < from.size(); i++)
+		if (from[i] >= 0 && from[i] != (int)i)
+			cost += cm.moveSlot;
+	return cost;
+}
+
+enum {
+	ME_DELETE,
+	ME_INSERT,
+	ME_KEEP
+};
+
+// align the old zeros oz with the new zeros at nzLo..nzHi-1 as
+// cheaply as possible. ops gets the alignment, left to right.
+long
+alignZeroSegment(const vector<unsigned int> &oz, unsigned int nzLo
+		, unsigned int nzHi, const EditCostModel &cm, vector<char> &ops)
+{
+	size_t p = oz.size();
+	size_t q = nzHi - nzLo;
+	ops.clear();
+	if ((p + 1) * (q + 1) > MinEditMaxCells)
+	{
+		long cost = 0;
+		for (size_t k = 0; k < max(p, q); k++)
+		{
+			if (k < p && k < q)
+			{
+				ops.push_back(ME_KEEP);
+				cost += (oz[k] == nzLo + k) ? 0 : cm.moveSlot;
+			}
+			else if (k < p)
+			{
+				ops.push_back(ME_DELETE);
+				cost += cm.deleteZero;
+			}
+			else
+			{
+				ops.push_back(ME_INSERT);
+				cost += cm.insertZero;
+			}
+		}
+		return cost;
+	}
+
+	// cost[j] is the cheapest way to line up the first i old zeros
+	// with the first j new ones, one row of i at a time
+	vector<long> prev(q + 1), cur(q + 1);
+	vector<char> how((p + 1) * (q + 1));
+	for (size_t j = 0; j <= q; j++)
+	{
+		prev[j] = j * cm.insertZero;
+		how[j] = ME_INSERT;
+	}
+	for (size_t i = 1; i <= p; i++)
+	{
+		cur[0] = i * cm.deleteZero;
+		how[i * (q + 1)] = ME_DELETE;
+		for (size_t j = 1; j <= q; j++)
+		{
+			long keep = prev[j-1]
+				+ ((oz[i-1] == nzLo + j - 1) ? 0 : cm.moveSlot);
+			long del = prev[j] + cm.deleteZero;
+			long ins = cur[j-1] + cm.insertZero;
+			char h = ME_KEEP;
+			long best = keep;
+			if (del < best)
+			{
+				best = del;
+				h = ME_DELETE;
+			}
+			if (ins < best)
+			{
+				best = ins;
+				h = ME_INSERT;
+			}
+			cur[j] = best;
+			how[i * (q + 1) + j] = h;
+		}
+		prev.swap(cur);
+	}
+	long cost = prev[q];
+	size_t i = p, j = q;
+	while (i || j)
+	{
+		char h = how[i * (q + 1) + j];
+		ops.push_back(h);
+		if (h != ME_INSERT)
+			i--;
+		if (h != ME_DELETE)
+			j--;
+	}
+	reverse(ops.begin(), ops.end());
+	return cost;
+}
+
+// reconcile w against si with the cheapest edit script under cm,
+// appending the edits to script (fixVectors' encoding) if given.
+// returns the cost, or -1 (leaving w alone) if the captured ids in
+// w are out of order, which no inserting and deleting can fix.
+long
+reconcileMinEdit(const SpecIndex &si, vector<int> &w
+		, const EditCostModel &cm, vector<int> *script = NULL)
+{
+	// the old positions of the surviving captured ids, and where
+	// they have to end up
+	vector<unsigned int> anchorOld, anchorNew;
+	vector<int> out(si.spec.size(), 0);
+	for (unsigned int i = 0; i < w.size(); i++)
+	{
+		if (w[i] == 0)
+			continue;
+		unordered_map<int, unsigned int>::const_iterator it;
+		it = si.posOf.find(w[i]);
+		if (it == si.posOf.end())
+			continue;
+		if (anchorNew.size() && it->second <= anchorNew.back())
+			return -1;
+		anchorOld.push_back(i);
+		anchorNew.push_back(it->second);
+		out[it->second] = w[i];
+	}
+
+	long cost = 0;
+	vector<int> edits;
+	vector<unsigned int> oz;
+	vector<char> ops;
+	unsigned int done = 0;	// slots of the result finished so far
+	unsigned int oldLo = 0, newLo = 0;
+	for (unsigned int k = 0; k <= anchorOld.size(); k++)
+	{
+		unsigned int oldHi = (k < anchorOld.size()) ? anchorOld[k] : w.size();
+		unsigned int newHi = (k < anchorNew.size()) ? anchorNew[k] : out.size();
+		oz.clear();
+		for (unsigned int i = oldLo; i < oldHi; i++)
+			if (w[i] == 0)
+				oz.push_back(i);
+		cost += alignZeroSegment(oz, newLo, newHi, cm, ops);
+
+		// walk the old segment, deleting dropped ids as they're
+		// passed. the slot being looked at is always done+1.
+		unsigned int i = oldLo;
+		for (unsigned int o = 0; o < ops.size(); o++)
+		{
+			if (ops[o] == ME_INSERT)
+			{
+				edits.push_back(done++);
+				continue;
+			}
+			for (; w[i] != 0; i++)
+			{
+				edits.push_back(0-(int)(done+1));
+				cost += cm.deleteCaptured;
+			}
+			if (ops[o] == ME_DELETE)
+				edits.push_back(0-(int)(done+1));
+			else
+				done++;
+			i++;
+		}
+		for (; i < oldHi; i++)
+		{
+			edits.push_back(0-(int)(done+1));
+			cost += cm.deleteCaptured;
+		}
+		if (k < anchorOld.size())
+		{
+			if (anchorOld[k] != anchorNew[k])
+				cost += cm.moveSlot;
+			done++;
+			oldLo = anchorOld[k] + 1;
+			newLo = anchorNew[k] + 1;
+		}
+	}
+	if (script)
+		script->insert(script->end(), edits.begin(), edits.end());
+	w.swap(out);
+	return cost;
+}
+
+//---------------------------------------------------------------
+// record payloads
+// in a capture file each captured id names a record with a body.
+// these reconcile a payload vector alongside w (payloads[i] goes
+// with w[i]), so the bodies end up next to their ids in the same
+// pass. payloads are only ever moved, never copied, so P can be a
+// move-only type like unique_ptr. slots with nothing captured get
+// a value-initialized P.
+//---------------------------------------------------------------
+// reconcileIndexed for a file with payloads. payloads of ids the
+// spec no longer has are destroyed. returns true if w changed.
+template <class P>
+bool
+reconcileRecords(const SpecIndex &si, vector<int> &w, vector<P> &payloads)
+{
+	vector<int> out(si.spec.size(), 0);
+	vector<P> outP(si.spec.size());
+	for (unsigned int i = 0; i < w.size(); i++)
+	{
+		if (w[i] == 0)
+			continue;
+		unordered_map<int, unsigned int>::const_iterator it;
+		it = si.posOf.find(w[i]);
+		if (it == si.posOf.end())
+			continue;
+		out[it->second] = w[i];
+		outP[it->second] = std::move(payloads[i]);
+	}
+	bool changed = (out != w);
+	w.swap(out);
+	payloads.swap(outP);
+	return changed;
+}
+
+// applyEditScript moving payloads along with their ids
+template <class P>
+void
+applyEditScript(const vector<int> &script, vector<int> &w
+		, vector<P> &payloads)
+{
+	for (unsigned int i = 0; i < script.size(); i++)
+	{
+		if (script[i] >= 0)
+		{
+			w.insert(w.begin() + script[i], 0);
+			payloads.insert(payloads.begin() + script[i], P());
+		}
+		else
+		{
+			w.erase(w.begin() + (0-script[i]-1));
+			payloads.erase(payloads.begin() + (0-script[i]-1));
+		}
+	}
+}
+
+//---------------------------------------------------------------
+// payload store
+// for big records even moving payloads around costs too much. in
+// this layout a file holds small handles into a PayloadStore
+// instead, and reconciling only rewrites the handle array; the
+// payloads never move. handles of dropped records are just marked
+// dead, and the store is compacted later, in one go for a whole
+// set of files, once enough of it is dead.
+//
+// handles are 1-based, so handle 0 means nothing captured, the same
+// as id 0.
+//---------------------------------------------------------------
+template <class P>
+struct PayloadStore {
+	vector<P> slots;	// handle h lives in slots[h-1]
+	vector<char> live;
+	size_t dead;
+};
+
+struct HandleFile {
+	vector<int> ids;
+	vector<uint32_t> handles;	// handles[i] goes with ids[i]
+};
+
+// compact once at least this many slots, and half the store, are dead
+const size_t MinDeadToCompact = 64;
+
+template <class P>
+void
+initPayloadStore(PayloadStore<P> &ps)
+{
+	ps.slots.clear();
+	ps.live.clear();
+	ps.dead = 0;
+}
+
+template <class P>
+uint32_t
+storePayload(PayloadStore<P> &ps, P &&p)
+{
+	ps.slots.push_back(std::move(p));
+	ps.live.push_back(1);
+	return ps.slots.size();
+}
+
+template <class P>
+P &
+payloadOf(PayloadStore<P> &ps, uint32_t h)
+{
+	return ps.slots[h-1];
+}
+
+// the slot stays where it is until the next compaction, but what
+// it held is freed now
+template <class P>
+void
+releasePayload(PayloadStore<P> &ps, uint32_t h)
+{
+	if (h == 0 || !ps.live[h-1])
+		return;
+	ps.slots[h-1] = P();
+	ps.live[h-1] = 0;
+	ps.dead++;
+}
+
+// reconcileIndexed for a handle file. returns true if it changed.
+template <class P>
+bool
+reconcileHandles(const SpecIndex &si, HandleFile &f, PayloadStore<P> &ps)
+{
+	vector<int> out(si.spec.size(), 0);
+	vector<uint32_t> outH(si.spec.size(), 0);
+	for (unsigned int i = 0; i < f.ids.size(); i++)
+	{
+		if (f.ids[i] == 0)
+			continue;
+		unordered_map<int, unsigned int>::const_iterator it;
+		it = si.posOf.find(f.ids[i]);
+		if (it == si.posOf.end())
+		{
+			releasePayload(ps, f.handles[i]);
+			continue;
+		}
+		// a repeated id keeps its last record, like reconcileIndexed
+		releasePayload(ps, outH[it->second]);
+		out[it->second] = f.ids[i];
+		outH[it->second] = f.handles[i];
+	}
+	bool changed = (out != f.ids);
+	f.ids.swap(out);
+	f.handles.swap(outH);
+	return changed;
+}
+
+template <class P>
+bool
+compactionDue(const PayloadStore<P> &ps)
+{
+	return ps.dead >= MinDeadToCompact && ps.dead * 2 >= ps.slots.size();
+}
+
+// pack the live payloads to the front of the store and renumber
+// the handles in files, which must be every file using the store
+template <class P>
+void
+compactPayloads(PayloadStore<P> &ps, const vector<HandleFile *> &files)
+{
+	vector<uint32_t> remap(ps.slots.size() + 1, 0);
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < ps.slots.size(); i++)
+	{
+		if (!ps.live[i])
+			continue;
+		if (next != i)
+			ps.slots[next] = std::move(ps.slots[i]);
+		remap[i+1] = ++next;
+	}
+	ps.slots.resize(next);
+	ps.live.assign(next, 1);
+	ps.dead = 0;
+	for (unsigned int k = 0; k < files.size(); k++)
+	{
+		vector<uint32_t> &h = files[k]->handles;
+		for (unsigned int i = 0; i < h.size(); i++)
+			h[i] = remap[h[i]];
+	}
+}
+
+//---------------------------------------------------------------
+// spec index cache
+// most file vectors are reconciled against one of a handful of
+// spec versions, so indexed specs are kept in an LRU keyed by
+// content hash. a hash hit is only trusted if the spec contents
+// match too; a collision simply counts as a miss and replaces the
+// older entry.
+//
+// the NotFoundSeq gap table that fixingW builds depends on the
+// file vector as well as the spec, so it isn't cached here.
+//---------------------------------------------------------------
+typedef list<shared_ptr<const SpecIndex> > SpecLRU;
+
+struct SpecIndexCache {
+	unsigned int capacity;
+	mutex lock;
+	SpecLRU lru;				// most recently used first
+	unordered_map<uint64_t, SpecLRU::iterator> byHash;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+void
+initSpecIndexCache(SpecIndexCache &c, unsigned int capacity)
+{
+	c.capacity = capacity ? capacity : 1;
+	c.lru.clear();
+	c.byHash.clear();
+	c.hits = 0;
+	c.misses = 0;
+}
+
+// look up the indexed form of spec a, building it on a miss
+shared_ptr<const SpecIndex>
+getSpecIndex(SpecIndexCache &c, const vector<int> &a)
+{
+	uint64_t h = hashSpec(a);
+	{
+		lock_guard<mutex> lk(c.lock);
+		unordered_map<uint64_t, SpecLRU::iterator>::iterator it;
+		it = c.byHash.find(h);
+		if (it != c.byHash.end() && (*it->second)->spec == a)
+		{
+			c.lru.splice(c.lru.begin(), c.lru, it->second);
+			c.hits++;
+			return c.lru.front();
+		}
+		c.misses++;
+	}
+
+	// build outside the lock, other lookups can proceed meanwhile
+	shared_ptr<SpecIndex> si(new SpecIndex);
+	buildSpecIndex(*si, a);
+
+	lock_guard<mutex> lk(c.lock);
+	unordered_map<uint64_t, SpecLRU::iterator>::iterator it;
+	it = c.byHash.find(h);
+	if (it != c.byHash.end())
+	{
+		c.lru.erase(it->second);
+		c.byHash.erase(it);
+	}
+	c.lru.push_front(si);
+	c.byHash[h] = c.lru.begin();
+	while (c.lru.size() > c.capacity)
+	{
+		c.byHash.erase(c.lru.back()->hash);
+		c.lru.pop_back();
+	}
+	return si;
+}
+
+void
+specCacheStats(SpecIndexCache &c, uint64_t &hits, uint64_t &misses)
+{
+	lock_guard<mutex> lk(c.lock);
+	hits = c.hits;
+	misses = c.misses;
+}
+
+// reconcile w against spec a, reusing a cached index of a if there is one
+bool
+reconcileCached(SpecIndexCache &c, const vector<int> &a, vector<int> &w)
+{
+	shared_ptr<const SpecIndex> si = getSpecIndex(c, a);
+	return reconcileIndexed(*si, w);
+}
+
+//---------------------------------------------------------------
+// compile-time reconciliation
+// for specs that are fixed at build time. fixArray gives the same
+// result as fixVectors but is constexpr over std::array, so the
+// reconciled layout of a known file can be computed by the
+// compiler. it doesn't replay fixVectors' edits (fixingW and
+// removeZeros work on vectors, with logging); it places each id
+// directly, which is the layout those edits end up at whenever the
+// captured ids ascend. the fixtures below pin the two together:
+// static_asserts for fixArray, and testSpecTransitionTable runs
+// fixVectors on the same files.
+//
+// more useful is the transition table: for a known old spec ->
+// new spec change, from[j] is the old position whose id belongs in
+// new slot j (or -1 for a slot that is new in the new spec). a file
+// laid out under the old spec can then be resynced by a plain
+// table-driven copy, with no searching at all.
+//---------------------------------------------------------------
+template <size_t N, size_t M>
+constexpr array<int, N>
+fixArray(const array<int, N> &a, const array<int, M> &w)
+{
+	array<int, N> out{};
+	for (size_t i = 0; i < N; i++)
+	{
+		for (size_t j = 0; j < M; j++)
+		{
+			if (w[j] != 0 && w[j] == a[i])
+			{
+				out[i] = a[i];
+				break;
+			}
+		}
+	}
+	return out;
+}
+
+// merge two ascending specs into a transition table. works on any
+// indexable container so the runtime plans can share it.
+template <class OldSpec, class NewSpec, class Table>
+constexpr void
+buildTransition(const OldSpec &oldSpec, size_t oldN
+		, const NewSpec &newSpec, size_t newN, Table &from)
+{
+	size_t i = 0;
+	for (size_t j = 0; j < newN; j++)
+	{
+		while (i < oldN && oldSpec[i] < newSpec[j])
+			i++;
+		if (i < oldN && oldSpec[i] == newSpec[j])
+			from[j] = (int)i++;
+		else
+			from[j] = -1;
+	}
+}
+
+template <size_t OldN, size_t NewN>
+struct SpecTransitionTable {
+	array<int, OldN> oldSpec;
+	array<int, NewN> newSpec;
+	array<int, NewN> from;
+};
+
+template <size_t OldN, size_t NewN>
+constexpr SpecTransitionTable<OldN, NewN>
+makeSpecTransition(const array<int, OldN> &oldSpec
+		, const array<int, NewN> &newSpec)
+{
+	SpecTransitionTable<OldN, NewN> t{};
+	t.oldSpec = oldSpec;
+	t.newSpec = newSpec;
+	buildTransition(oldSpec, OldN, newSpec, NewN, t.from);
+	return t;
+}
+
+// resync w, which must be laid out under t.oldSpec, to t.newSpec.
+// returns false (leaving w alone) if w doesn't have the old layout;
+// the caller should fall back to fixVectors then.
+template <size_t OldN, size_t NewN>
+bool
+resyncFromTable(const SpecTransitionTable<OldN, NewN> &t, vector<int> &w)
+{
+	if (w.size() != OldN)
+		return false;
+	for (size_t i = 0; i < OldN; i++)
+	{
+		if (w[i] != 0 && w[i] != t.oldSpec[i])
+			return false;
+	}
+	vector<int> out(NewN);
+	for (size_t j = 0; j < NewN; j++)
+		out[j] = (t.from[j] < 0) ? 0 : w[t.from[j]];
+	w.swap(out);
+	return true;
+}
+
+//---------------------------------------------------------------
+// transition plans
+// the runtime version of the tables above. spec changes roll out
+// as versioned transitions, and every file written under the old
+// spec gets reconciled against the new one, so the diff between
+// the two specs is worked out once, up front. to[k] is the new
+// position of old slot k, or -1 if that id was dropped.
+//
+// applying a plan is one pass over the file that both checks it
+// really has the old layout and moves each slot to its new home.
+// files that don't match the old layout go through fixVectors.
+//---------------------------------------------------------------
+struct TransitionPlan {
+	vector<int> oldSpec;
+	vector<int> newSpec;
+	vector<int> to;
+};
+
+void
+buildTransitionPlan(TransitionPlan &tp, const vector<int> &oldSpec
+		, const vector<int> &newSpec)
+{
+	tp.oldSpec = oldSpec;
+	tp.newSpec = newSpec;
+	vector<int> from(newSpec.size());
+	buildTransition(oldSpec, oldSpec.size(), newSpec, newSpec.size(), from);
+	tp.to.assign(oldSpec.size(), -1);
+	for (unsigned int j = 0; j < from.size(); j++)
+	{
+		if (from[j] >= 0)
+			tp.to[from[j]] = j;
+	}
+}
+
+// returns true if the plan was used, false if w had to go through
+// fixVectors instead. either way w ends up matching tp.newSpec.
+bool
+applyTransitionPlan(TransitionPlan &tp, vector<int> &w)
+{
+	if (w.size() == tp.oldSpec.size())
+	{
+		vector<int> out(tp.newSpec.size(), 0);
+		unsigned int k;
+		for (k = 0; k < w.size(); k++)
+		{
+			int v = w[k];
+			if (v == 0)
+				continue;
+			if (v != tp.oldSpec[k])
+				break;
+			if (tp.to[k] >= 0)
+				out[tp.to[k]] = v;
+		}
+		if (k == w.size())
+		{
+			w.swap(out);
+			return true;
+		}
+	}
+	fixVectors(tp.newSpec, w);
+	return false;
+}
+
+//---------------------------------------------------------------
+// spec generations
+// every spec version registered with a SpecRegistry gets the next
+// generation number, and a transition plan from the one before it.
+// a StampedFile remembers the generation (and spec hash) it was
+// last reconciled against, so bringing it up to date is:
+//	same generation		nothing to do
+//	an older one		apply the plans in between, in order
+//	anything else		a full reconcile
+// a stamp is only trusted if its hash matches the registry's, so
+// a file stamped by some other registry gets the full reconcile.
+// long chains go straight to the full reconcile too: each plan is
+// a pass over the file, and one indexed pass beats many.
+//---------------------------------------------------------------
+struct SpecVersion {
+	uint64_t hash;
+	SpecIndex index;
+	TransitionPlan fromPrev;	// empty for generation 1
+};
+
+struct SpecRegistry {
+	vector<SpecVersion> versions;	// generation g is versions[g-1]
+	uint64_t current;	// files already at the target generation
+	uint64_t deltas;	// plans applied
+	uint64_t full;		// files reconciled from scratch
+};
+
+struct StampedFile {
+	vector<int> w;
+	uint32_t generation;	// 0 if never reconciled
+	uint64_t specHash;
+};
+
+const unsigned int MaxDeltaChain = 8;
+
+void
+initSpecRegistry(SpecRegistry &reg)
+{
+	reg.versions.clear();
+	reg.current = 0;
+	reg.deltas = 0;
+	reg.full = 0;
+}
+
+// returns the generation of spec, which is the latest one again if
+// the spec didn't actually change
+uint32_t
+registerSpec(SpecRegistry &reg, const vector<int> &spec)
+{
+	uint64_t hash = hashSpec(spec);
+	if (reg.versions.size() && reg.versions.back().hash == hash
+			&& reg.versions.back().index.spec == spec)
+		return reg.versions.size();
+	reg.versions.push_back(SpecVersion());
+	SpecVersion &v = reg.versions.back();
+	v.hash = hash;
+	buildSpecIndex(v.index, spec);
+	if (reg.versions.size() > 1)
+		buildTransitionPlan(v.fromPrev
+				, reg.versions[reg.versions.size() - 2].index.spec, spec);
+	return reg.versions.size();
+}
+
+// bring f up to date with generation target. returns 1 if f
+// changed, 0 if it didn't, or -1 (leaving f alone) if target isn't
+// a registered generation.
+int
+reconcileToGeneration(SpecRegistry &reg, StampedFile &f, uint32_t target)
+{
+	if (target == 0 || target > reg.versions.size())
+		return -1;
+	SpecVersion &to = reg.versions[target-1];
+	if (f.generation == target && f.specHash == to.hash)
+	{
+		reg.current++;
+		return 0;
+	}
+	vector<int> before = f.w;
+	if (f.generation > 0 && f.generation < target
+			&& target - f.generation <= MaxDeltaChain
+			&& f.specHash == reg.versions[f.generation-1].hash)
+	{
+		for (uint32_t g = f.generation + 1; g <= target; g++)
+			applyTransitionPlan(reg.versions[g-1].fromPrev, f.w);
+		reg.deltas += target - f.generation;
+	}
+	else
+	{
+		reconcileIndexed(to.index, f.w);
+		reg.full++;
+	}
+	f.generation = target;
+	f.specHash = to.hash;
+	return (f.w != before) ? 1 : 0;
+}
+
+//---------------------------------------------------------------
+// parallel reconcile
+// for very large files. any captured id that is still in the spec
+// is an anchor: everything before it in w can only belong before
+// it in a, and likewise after. so cutting both vectors at a few
+// anchors gives independent segments that can be reconciled on
+// their own threads and then joined back together.
+//
+// cutting is only safe when the captured ids in w are ascending;
+// if they aren't, or the file is too small to be worth it, this
+// is just fixVectors.
+//---------------------------------------------------------------
+const unsigned int ParallelMinSegment = 512;
+
+// reconcile each segment (a[cutA[k]..cutA[k+1]) against
+// w[cutW[k]..cutW[k+1])) on its own thread. every thread copies its
+// own segment in and, since a reconciled segment is as long as its
+// piece of a, straight into its final place in the result. the call
+// is recorded in stats and replay capture once, as a whole. with
+// oneThread the segments run one after another on this thread.
+bool
+reconcileSegments(vector<int> &a, vector<int> &w
+		, const vector<unsigned int> &cutA, const vector<unsigned int> &cutW
+		, bool oneThread)
+{
+	ReplayGuard replay(a, w, 0);
+	size_t slots = w.size();
+	unsigned int nSegs = cutA.size() - 1;
+	vector<vector<int> > segW(nSegs);
+	vector<CallStats> segStats(nSegs);
+	vector<char> ok(nSegs, 0);
+	vector<int> out(a.size());
+	auto work = [&](unsigned int k) {
+		bool saved = DebugLog;
+		DebugLog = false;
+		NestedCall = &segStats[k];
+		vector<int> segA(a.begin() + cutA[k], a.begin() + cutA[k+1]);
+		segW[k].assign(w.begin() + cutW[k], w.begin() + cutW[k+1]);
+		ok[k] = fixVectors(segA, segW[k]) && segW[k].size() == segA.size();
+		if (ok[k])
+			copy(segW[k].begin(), segW[k].end(), out.begin() + cutA[k]);
+		NestedCall = NULL;
+		DebugLog = saved;
+	};
+	vector<thread> workers;
+	for (unsigned int k = 0; k < nSegs; k++)
+	{
+		memset(&segStats[k], 0, sizeof(segStats[k]));
+		if (oneThread)
+			work(k);
+		else
+			workers.push_back(thread(work, k));
+	}
+	for (unsigned int k = 0; k < workers.size(); k++)
+		workers[k].join();
+	CallStats cs;
+	memset(&cs, 0, sizeof(cs));
+	bool allOk = true;
+	for (unsigned int k = 0; k < nSegs; k++)
+	{
+		allOk = allOk && ok[k];
+		addCallStats(cs, segStats[k]);
+	}
+	if (allOk)
+		w.swap(out);
+	else
+	{
+		// something didn't line up; hand back what the segments got
+		w.clear();
+		for (unsigned int k = 0; k < nSegs; k++)
+			w.insert(w.end(), segW[k].begin(), segW[k].end());
+	}
+	recordReconcileStats(slots, cs);
+	return allOk;
+}
+
+// returns true if the vectors are in sync afterwards. oneThread
+// cuts the file the same way but reconciles the segments in turn on
+// the calling thread, which lets the benchmark tell the gain from
+// cutting apart from the gain from threads.
+bool
+fixVectorsParallel(vector<int> &a, vector<int> &w, unsigned int nThreads
+		, bool oneThread = false)
+{
+	if (nThreads > w.size() / ParallelMinSegment)
+		nThreads = w.size() / ParallelMinSegment;
+	if (nThreads > a.size() / ParallelMinSegment)
+		nThreads = a.size() / ParallelMinSegment;
+	if (nThreads < 2)
+		return fixVectors(a, w);
+
+	// each thread checks that its stretch of w ascends; then only
+	// the joins between stretches are left
+	vector<int> firstId(nThreads, 0);
+	vector<int> lastId(nThreads, 0);
+	vector<char> sorted(nThreads, 1);
+	vector<thread> checkers;
+	const size_t stretch = (w.size() + nThreads - 1) / nThreads;
+	for (unsigned int t = 0; t < nThreads; t++)
+	{
+		checkers.push_back(thread([&, t]() {
+			size_t end = min(w.size(), (t + 1) * stretch);
+			int last = 0;
+			for (size_t i = t * stretch; i < end; i++)
+			{
+				if (w[i] == 0)
+					continue;
+				if (w[i] <= last)
+				{
+					sorted[t] = 0;
+					break;
+				}
+				if (last == 0)
+					firstId[t] = w[i];
+				last = w[i];
+			}
+			lastId[t] = last;
+		}));
+	}
+	bool ascending = true;
+	int last = 0;
+	for (unsigned int t = 0; t < nThreads; t++)
+	{
+		checkers[t].join();
+		if (!sorted[t] || (firstId[t] && firstId[t] <= last))
+			ascending = false;
+		if (lastId[t])
+			last = lastId[t];
+	}
+	if (!ascending)
+		return fixVectors(a, w);
+
+	// pick one anchor at or after each even split of w. cuts[k]
+	// is where segment k starts in a and in w.
+	vector<unsigned int> cutA(1, 0);
+	vector<unsigned int> cutW(1, 0);
+	for (unsigned int t = 1; t < nThreads; t++)
+	{
+		unsigned int i = t * (w.size() / nThreads);
+		if (i <= cutW.back())
+			i = cutW.back() + 1;
+		for (; i < w.size(); i++)
+		{
+			if (w[i] == 0)
+				continue;
+			vector<int>::iterator it;
+			it = lower_bound(a.begin() + cutA.back(), a.end(), w[i]);
+			if (it != a.end() && (*it) == w[i]
+					&& (unsigned int)(it - a.begin()) > cutA.back())
+			{
+				cutA.push_back(it - a.begin());
+				cutW.push_back(i);
+				break;
+			}
+		}
+	}
+	cutA.push_back(a.size());
+	cutW.push_back(w.size());
+	if (cutA.size() - 1 < 2)
+		return fixVectors(a, w);
+	return reconcileSegments(a, w, cutA, cutW, oneThread);
+}
+
+//---------------------------------------------------------------
+// file snapshots
+// a persistent, copy-on-write form of a file vector: chunks of
+// about FileChunkLen slots behind shared pointers. taking a
+// snapshot for a reader only copies the chunk pointers, and
+// reconciling a snapshot builds a new version that shares every
+// chunk whose contents come out unchanged, wherever they land: an
+// insert or delete only rebuilds the chunk it falls in, and the
+// chunks after it are shared at their new offsets. old versions
+// stay valid for as long as someone holds them.
+//
+// chunks vary in length, so starts[c] records where chunk c begins.
+// a rebuilt stretch is cut back into pieces of about FileChunkLen,
+// and one that would come out shorter than half that takes in the
+// chunk next to it rather than leave a sliver.
+//---------------------------------------------------------------
+const unsigned int FileChunkLen = 256;
+
+typedef shared_ptr<const vector<int> > FileChunk;
+
+struct FileSnapshot {
+	vector<FileChunk> chunks;
+	vector<unsigned int> starts;	// slot where each chunk begins
+	unsigned int size;
+};
+
+void
+addChunk(FileSnapshot &fs, FileChunk chunk)
+{
+	fs.starts.push_back(fs.size);
+	fs.size += chunk->size();
+	fs.chunks.push_back(chunk);
+}
+
+// cut slots [0, n) of get() into pieces of about FileChunkLen
+template <class F>
+void
+addChunks(FileSnapshot &fs, unsigned int from, unsigned int n, F get)
+{
+	unsigned int pieces = max(1u, (n + FileChunkLen / 2) / FileChunkLen);
+	for (unsigned int p = 0; p < pieces && n; p++)
+	{
+		unsigned int lo = (unsigned int)((uint64_t)n * p / pieces);
+		unsigned int hi = (unsigned int)((uint64_t)n * (p+1) / pieces);
+		shared_ptr<vector<int> > chunk(new vector<int>(hi - lo));
+		for (unsigned int i = lo; i < hi; i++)
+			(*chunk)[i - lo] = get(from + i);
+		addChunk(fs, chunk);
+	}
+}
+
+void
+makeSnapshot(FileSnapshot &fs, const vector<int> &w)
+{
+	fs.chunks.clear();
+	fs.starts.clear();
+	fs.size = 0;
+	addChunks(fs, 0, w.size(), [&](unsigned int i) { return w[i]; });
+}
+
+int
+snapshotAt(const FileSnapshot &fs, unsigned int i)
+{
+	unsigned int c = upper_bound(fs.starts.begin(), fs.starts.end(), i)
+			- fs.starts.begin() - 1;
+	return (*fs.chunks[c])[i - fs.starts[c]];
+}
+
+void
+flattenSnapshot(const FileSnapshot &fs, vector<int> &w)
+{
+	w.clear();
+	w.reserve(fs.size);
+	for (unsigned int c = 0; c < fs.chunks.size(); c++)
+		w.insert(w.end(), fs.chunks[c]->begin(), fs.chunks[c]->end());
+}
+
+// reconcile 'from' against si into a new version 'to'. 'from' is
+// left untouched. returns true if anything changed.
+bool
+reconcileSnapshot(const SpecIndex &si, const FileSnapshot &from
+		, FileSnapshot &to)
+{
+	// which spec slots have been captured: a bit per slot rather
+	// than a copy of the file
+	const unsigned int n = si.spec.size();
+	vector<bool> captured(n, false);
+	for (unsigned int c = 0; c < from.chunks.size(); c++)
+	{
+		const vector<int> &chunk = *from.chunks[c];
+		for (unsigned int i = 0; i < chunk.size(); i++)
+		{
+			if (chunk[i] == 0)
+				continue;
+			unordered_map<int, unsigned int>::const_iterator it;
+			it = si.posOf.find(chunk[i]);
+			if (it != si.posOf.end())
+				captured[it->second] = true;
+		}
+	}
+	auto slot = [&](unsigned int j) { return captured[j] ? si.spec[j] : 0; };
+
+	// walk the old chunks in order. a chunk is shared if its
+	// contents turn up intact at or after the next slot still to be
+	// filled: where its first kept id now sits, or right there if it
+	// has none. whatever falls between shared chunks is rebuilt.
+	to.chunks.clear();
+	to.starts.clear();
+	to.size = 0;
+	unsigned int pos = 0;
+	bool changed = false;
+	for (unsigned int c = 0; c < from.chunks.size(); c++)
+	{
+		const vector<int> &chunk = *from.chunks[c];
+		unsigned int len = chunk.size();
+		unsigned int at = pos;
+		for (unsigned int i = 0; i < len; i++)
+		{
+			if (chunk[i] == 0)
+				continue;
+			unordered_map<int, unsigned int>::const_iterator it;
+			it = si.posOf.find(chunk[i]);
+			if (it != si.posOf.end())
+			{
+				at = (it->second >= i) ? it->second - i : UINT_MAX;
+				break;
+			}
+		}
+		bool same = at != UINT_MAX && at >= pos && (uint64_t)at + len <= n
+				&& (at == pos || at - pos >= FileChunkLen / 2);
+		for (unsigned int i = 0; same && i < len; i++)
+			same = (slot(at + i) == chunk[i]);
+		if (!same)
+			continue;
+		if (at > pos)
+			addChunks(to, pos, at - pos, slot);
+		if (at != from.starts[c])
+			changed = true;
+		addChunk(to, from.chunks[c]);
+		pos = at + len;
+	}
+	// a short tail goes in with the chunk in front of it
+	if (pos < n && n - pos < FileChunkLen / 2 && !to.chunks.empty())
+	{
+		pos = to.starts.back();
+		to.size = pos;
+		to.starts.pop_back();
+		to.chunks.pop_back();
+	}
+	if (pos < n)
+		addChunks(to, pos, n - pos, slot);
+
+	// anything rebuilt means the contents moved or changed
+	if (!changed)
+	{
+		changed = (to.chunks.size() != from.chunks.size());
+		for (unsigned int c = 0; !changed && c < to.chunks.size(); c++)
+			changed = (to.chunks[c] != from.chunks[c]);
+	}
+	return changed;
+}
+
+//---------------------------------------------------------------
+// file vector publication
+// lets capture workers keep reading a file vector while the resync
+// thread reconciles it. the resync builds the reconciled vector off
+// to the side and swaps it in with one atomic pointer exchange, so
+// readers never wait on a resync.
+//
+// old versions are freed by epoch: every reader slot records the
+// epoch it started reading in, and a retired vector is deleted
+// once every reader still inside a read started after it was
+// retired.
+//
+// reader slots come in blocks of MaxReaders. when every slot is
+// taken, registerReader hangs another block off the end of the list
+// with a compare-and-swap, so there's no limit on readers and none
+// of them ever takes a lock. blocks are only freed with the
+// publisher.
+//---------------------------------------------------------------
+const unsigned int MaxReaders = 64;
+
+struct ReaderBlock {
+	atomic<uint64_t> readerEpoch[MaxReaders];	// 0 = not reading
+	atomic<bool> slotUsed[MaxReaders];
+	atomic<ReaderBlock *> next;
+};
+
+struct FileVecPublisher {
+	atomic<const vector<int> *> current;
+	atomic<uint64_t> epoch;
+	ReaderBlock readers;			// first block of reader slots
+	mutex writerLock;				// serializes resyncs only
+	vector<pair<uint64_t, const vector<int> *> > retired;
+};
+
+void
+initReaderBlock(ReaderBlock &b)
+{
+	for (unsigned int i = 0; i < MaxReaders; i++)
+	{
+		b.readerEpoch[i] = 0;
+		b.slotUsed[i] = false;
+	}
+	b.next = NULL;
+}
+
+void
+initPublisher(FileVecPublisher &p, const vector<int> &w)
+{
+	p.current = new vector<int>(w);
+	p.epoch = 1;
+	initReaderBlock(p.readers);
+	p.retired.clear();
+}
+
+// free whatever no reader can still be looking at. writerLock held.
+void
+reclaimRetired(FileVecPublisher &p)
+{
+	uint64_t oldest = UINT64_MAX;
+	for (ReaderBlock *b = &p.readers; b; b = b->next.load())
+	{
+		for (unsigned int i = 0; i < MaxReaders; i++)
+		{
+			uint64_t e = b->readerEpoch[i].load();
+			if (e != 0 && e < oldest)
+				oldest = e;
+		}
+	}
+	unsigned int keep = 0;
+	for (unsigned int i = 0; i < p.retired.size(); i++)
+	{
+		if (p.retired[i].first < oldest)
+			delete p.retired[i].second;
+		else
+			p.retired[keep++] = p.retired[i];
+	}
+	p.retired.resize(keep);
+}
+
+// only call once all readers are gone
+void
+destroyPublisher(FileVecPublisher &p)
+{
+	lock_guard<mutex> lk(p.writerLock);
+	reclaimRetired(p);
+	delete p.current.load();
+	p.current = NULL;
+	ReaderBlock *b = p.readers.next.exchange(NULL);
+	while (b)
+	{
+		ReaderBlock *next = b->next.load();
+		delete b;
+		b = next;
+	}
+}
+
+// each reader thread claims a slot once, adding a block if every
+// slot is taken
+int
+registerReader(FileVecPublisher &p)
+{
+	ReaderBlock *b = &p.readers;
+	for (int base = 0; ; base += MaxReaders)
+	{
+		for (unsigned int i = 0; i < MaxReaders; i++)
+		{
+			bool expected = false;
+			if (b->slotUsed[i].compare_exchange_strong(expected, true))
+				return base + i;
+		}
+		ReaderBlock *next = b->next.load();
+		if (!next)
+		{
+			// if another reader got a block in first, use theirs
+			ReaderBlock *fresh = new ReaderBlock;
+			initReaderBlock(*fresh);
+			if (b->next.compare_exchange_strong(next, fresh))
+				next = fresh;
+			else
+				delete fresh;
+		}
+		b = next;
+	}
+}
+
+// the block a slot lives in
+ReaderBlock &
+readerBlock(FileVecPublisher &p, int slot)
+{
+	ReaderBlock *b = &p.readers;
+	for (int i = slot / MaxReaders; i > 0; i--)
+		b = b->next.load();
+	return *b;
+}
+
+void
+releaseReader(FileVecPublisher &p, int slot)
+{
+	ReaderBlock &b = readerBlock(p, slot);
+	b.readerEpoch[slot % MaxReaders] = 0;
+	b.slotUsed[slot % MaxReaders] = false;
+}
+
+// the returned vector stays valid until readUnlock
+const vector<int> *
+readLock(FileVecPublisher &p, int slot)
+{
+	readerBlock(p, slot).readerEpoch[slot % MaxReaders].store(p.epoch.load());
+	return p.current.load();
+}
+
+void
+readUnlock(FileVecPublisher &p, int slot)
+{
+	readerBlock(p, slot).readerEpoch[slot % MaxReaders].store(0);
+}
+
+// swap in a new version. a reader that saw an epoch up to the one
+// returned by fetch_add may still hold the old version; anyone
+// later is guaranteed to see the new one. writerLock held.
+void
+swapIn(FileVecPublisher &p, const vector<int> *fresh)
+{
+	const vector<int> *old = p.current.exchange(fresh);
+	uint64_t retiredAt = p.epoch.fetch_add(1);
+	p.retired.push_back(make_pair(retiredAt, old));
+	reclaimRetired(p);
+}
+
+// the publisher owns 'fresh' from here on
+void
+publish(FileVecPublisher &p, const vector<int> *fresh)
+{
+	lock_guard<mutex> lk(p.writerLock);
+	swapIn(p, fresh);
+}
+
+// reconcile the published vector against a and publish the result.
+// returns true if the vectors are in sync afterwards.
+bool
+reconcileAndPublish(FileVecPublisher &p, vector<int> &a)
+{
+	lock_guard<mutex> lk(p.writerLock);
+	vector<int> *fresh = new vector<int>(*p.current.load());
+	bool ok = fixVectors(a, *fresh);
+	swapIn(p, fresh);
+	return ok;
+}
+
+//---------------------------------------------------------------
+// capture during resync
+// capture keeps filling zeros with ids while a spec change is being
+// reconciled. a CaptureFile routes each fill either straight into
+// its slot or, while a resync is running, into a lock-free log.
+// when the reconciled layout is ready the log is replayed onto it
+// with the same id -> position lookup the reconcile used, so no
+// fill is lost and capture never waits for the resync.
+//
+// fills that land directly are atomic stores into the slot. the
+// activeFills counts are the handshake: a resync raises resyncing,
+// then waits for fills already past the check to finish, which
+// takes no longer than a single store. fills count themselves
+// under the current fillPhase, and waitForFills flips the phase
+// before it waits, so it only waits for fills that started before
+// the flip; fills that keep arriving can't hold it up.
+//---------------------------------------------------------------
+struct FillLog {
+	unique_ptr<atomic<int>[]> ids;	// 0 = claimed but not written yet
+	unsigned int capacity;
+	atomic<unsigned int> tail;
+};
+
+void
+initFillLog(FillLog &log, unsigned int capacity)
+{
+	log.ids.reset(new atomic<int>[capacity]);
+	log.capacity = capacity;
+	for (unsigned int i = 0; i < capacity; i++)
+		log.ids[i] = 0;
+	log.tail = 0;
+}
+
+// lock free; returns false if the log is full
+bool
+logFill(FillLog &log, int id)
+{
+	unsigned int i = log.tail.fetch_add(1);
+	if (i >= log.capacity)
+		return false;
+	log.ids[i].store(id);
+	return true;
+}
+
+// put every logged id into its slot in w, then empty the log.
+// nothing may be logging while this runs.
+void
+replayFills(FillLog &log, const SpecIndex &si, vector<int> &w)
+{
+	unsigned int n = min(log.tail.load(), log.capacity);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		int id = log.ids[i].load();
+		log.ids[i] = 0;
+		unordered_map<int, unsigned int>::const_iterator it;
+		it = si.posOf.find(id);
+		if (it != si.posOf.end())
+			atomic_ref<int>(w[it->second]).store(id);
+	}
+	log.tail = 0;
+}
+
+struct CaptureLayout {
+	shared_ptr<const SpecIndex> si;
+	vector<int> w;
+};
+
+struct CaptureFile {
+	atomic<CaptureLayout *> layout;
+	atomic<bool> resyncing;
+	atomic<const SpecIndex *> incoming;	// the spec a resync is moving to
+	atomic<unsigned int> fillPhase;
+	atomic<int> activeFills[2];
+	FillLog log;
+	mutex resyncLock;
+};
+
+void
+initCaptureFile(CaptureFile &cf, shared_ptr<const SpecIndex> si
+		, const vector<int> &w, unsigned int logCapacity)
+{
+	CaptureLayout *cl = new CaptureLayout;
+	cl->si = si;
+	cl->w = w;
+	cf.layout = cl;
+	cf.resyncing = false;
+	cf.incoming = si.get();
+	cf.fillPhase = 0;
+	cf.activeFills[0] = 0;
+	cf.activeFills[1] = 0;
+	initFillLog(cf.log, logCapacity);
+}
+
+void
+destroyCaptureFile(CaptureFile &cf)
+{
+	delete cf.layout.load();
+	cf.layout = NULL;
+}
+
+// record a captured id. returns false if the id isn't in the spec
+// (the one being resynced to, while a resync runs), or if a resync
+// is running and its log is full (try again later).
+bool
+captureFill(CaptureFile &cf, int id)
+{
+	bool ok = false;
+	// count ourselves under the phase that is current after the
+	// increment, so a waitForFills that flipped it either sees us
+	// or we see its flip and move to the new phase
+	unsigned int phase;
+	for (;;)
+	{
+		phase = cf.fillPhase.load();
+		cf.activeFills[phase]++;
+		if (cf.fillPhase.load() == phase)
+			break;
+		cf.activeFills[phase]--;
+	}
+	if (cf.resyncing)
+	{
+		const SpecIndex *si = cf.incoming;
+		if (si->posOf.count(id))
+			ok = logFill(cf.log, id);
+	}
+	else
+	{
+		CaptureLayout *cl = cf.layout;
+		unordered_map<int, unsigned int>::const_iterator it;
+		it = cl->si->posOf.find(id);
+		if (it != cl->si->posOf.end())
+		{
+			atomic_ref<int>(cl->w[it->second]).store(id);
+			ok = true;
+		}
+	}
+	cf.activeFills[phase]--;
+	return ok;
+}
+
+// wait for the fills that started before this call. resyncLock held.
+void
+waitForFills(CaptureFile &cf)
+{
+	unsigned int phase = cf.fillPhase.fetch_xor(1);
+	while (cf.activeFills[phase].load())
+		this_thread::yield();
+}
+
+// copy out the slots. fills may land while this runs, but it must
+// not overlap a resync; call it from the thread that does those.
+void
+captureFileContents(CaptureFile &cf, vector<int> &w)
+{
+	CaptureLayout *cl = cf.layout;
+	w.resize(cl->w.size());
+	for (unsigned int i = 0; i < w.size(); i++)
+		w[i] = atomic_ref<int>(cl->w[i]).load();
+}
+
+// reconcile the file against a new spec while capture carries on
+void
+resyncCaptureFile(CaptureFile &cf, shared_ptr<const SpecIndex> si)
+{
+	lock_guard<mutex> lk(cf.resyncLock);
+	cf.incoming = si.get();
+	cf.resyncing = true;
+	waitForFills(cf);
+
+	// nothing writes the old layout from here on
+	CaptureLayout *old = cf.layout;
+	CaptureLayout *cl = new CaptureLayout;
+	cl->si = si;
+	cl->w = old->w;
+	reconcileIndexed(*si, cl->w);
+	cf.layout = cl;
+
+	// new fills go straight to the new layout; once the stragglers
+	// that were still logging are done, replay what they logged
+	cf.resyncing = false;
+	waitForFills(cf);
+	replayFills(cf.log, *si, cl->w);
+	delete old;
+}
+
+//---------------------------------------------------------------
+// file vector batches
+// most files are small, and reconciling millions of separate
+// vector<int>s costs a pointer chase and a cache miss each. a
+// batch stores many files back to back in one flat buffer, with
+// file k at ids[offsets[k] .. offsets[k+1]). reconcileBatch (below,
+// after the fused kernel it falls back on) walks it front to back
+// and writes the results into a second batch, so both sides are
+// plain sequential streams.
+//---------------------------------------------------------------
+struct FileVecBatch {
+	vector<unsigned int> offsets;
+	vector<int> ids;
+};
+
+void
+initBatch(FileVecBatch &b)
+{
+	b.offsets.assign(1, 0);
+	b.ids.clear();
+}
+
+void
+batchAppend(FileVecBatch &b, const vector<int> &w)
+{
+	b.ids.insert(b.ids.end(), w.begin(), w.end());
+	b.offsets.push_back(b.ids.size());
+}
+
+unsigned int
+batchCount(const FileVecBatch &b)
+{
+	return b.offsets.size() - 1;
+}
+
+void
+batchFile(const FileVecBatch &b, unsigned int k, vector<int> &w)
+{
+	w.assign(b.ids.begin() + b.offsets[k], b.ids.begin() + b.offsets[k+1]);
+}
+
+//---------------------------------------------------------------
+// fused batch reconcile
+// the other way to reconcile a batch that shares one spec: walk the
+// spec once and move a cursor through every file in lockstep. each
+// file's captured ids are first packed into a lane (zeros dropped,
+// INT_MAX on the end), so at spec slot j a lane's cursor is sitting
+// on spec[j] or it isn't, and the step is a compare and an add with
+// no branch. the only loop left skips ids dropped from the spec,
+// which is rare. files go through FusedLanes at a time: the spec is
+// read once per group, always out of L1, and the group's output
+// rows stay in cache while they fill.
+//
+// this doesn't care how big the ids are, which makes it the path
+// reconcileBatch takes for specs too sparse for its lookup table.
+// the lockstep walk does need ascending captured ids; a file that
+// doesn't have them is looked up id by id instead.
+//---------------------------------------------------------------
+const unsigned int FusedLanes = 16;
+
+void
+reconcileFused(const SpecIndex &si, const FileVecBatch &in, FileVecBatch &out)
+{
+	const unsigned int n = si.spec.size();
+	const unsigned int count = batchCount(in);
+	out.offsets.resize(count + 1);
+	for (unsigned int k = 0; k <= count; k++)
+		out.offsets[k] = k * n;
+	out.ids.resize((size_t)count * n);
+
+	const int *spec = si.spec.data();
+	const int *src = in.ids.data();
+	vector<int> packed;
+	unsigned int cur[FusedLanes];
+	unsigned int end[FusedLanes];
+	int *dst[FusedLanes];
+
+	// the spec ascends, so INT_MAX can only be its last id. the
+	// sentinel would match it in every lane, so that slot is done
+	// apart, against each lane's real end.
+	const unsigned int body = (n && spec[n-1] == INT_MAX) ? n - 1 : n;
+	for (unsigned int base = 0; base < count; base += FusedLanes)
+	{
+		// pack the group's files into lanes. every id is stored, but
+		// the end only moves past the non-zero ones.
+		unsigned int lanes = 0;
+		unsigned int last = min(count, base + FusedLanes);
+		packed.resize(in.offsets[last] - in.offsets[base] + FusedLanes);
+		unsigned int m = 0;
+		for (unsigned int k = base; k < last; k++)
+		{
+			int *row = out.ids.data() + (size_t)k * n;
+			unsigned int first = m;
+			int prev = 0;
+			int unordered = 0;
+			for (unsigned int i = in.offsets[k]; i < in.offsets[k+1]; i++)
+			{
+				int id = src[i];
+				packed[m] = id;
+				m += (id != 0);
+				unordered |= (id != 0) & (id <= prev);
+				prev = id ? id : prev;
+			}
+			if (unordered)
+			{
+				memset(row, 0, n * sizeof(int));
+				for (unsigned int i = first; i < m; i++)
+				{
+					unordered_map<int, unsigned int>::const_iterator it;
+					it = si.posOf.find(packed[i]);
+					if (it != si.posOf.end())
+						row[it->second] = packed[i];
+				}
+				m = first;
+				continue;
+			}
+			end[lanes] = m;
+			packed[m++] = INT_MAX;
+			cur[lanes] = first;
+			dst[lanes] = row;
+			lanes++;
+		}
+
+		const int *p = packed.data();
+		for (unsigned int j = 0; j < body; j++)
+		{
+			int v = spec[j];
+			for (unsigned int l = 0; l < lanes; l++)
+			{
+				unsigned int c = cur[l];
+				while (p[c] < v)
+					c++;
+				int hit = (p[c] == v);
+				dst[l][j] = v & -hit;
+				cur[l] = c + hit;
+			}
+		}
+		for (unsigned int l = 0; body < n && l < lanes; l++)
+		{
+			unsigned int c = cur[l];
+			while (c < end[l] && p[c] < INT_MAX)
+				c++;
+			dst[l][body] = (c < end[l]) ? INT_MAX : 0;
+		}
+	}
+}
+
+// reconcile every file in 'in' against si into 'out'. when the ids
+// are small enough, a flat id -> slot table (zero and unknown ids
+// point at a scratch slot past the end of the row) turns every id
+// into one load and one store with no branches. when they aren't,
+// this is reconcileFused.
+void
+reconcileBatch(const SpecIndex &si, const FileVecBatch &in, FileVecBatch &out)
+{
+	const unsigned int n = si.spec.size();
+	const int *spec = si.spec.data();
+	int maxId = n ? spec[n-1] : 0;
+	if (maxId < 0 || (size_t)maxId > 4 * (size_t)n + 4096)
+	{
+		reconcileFused(si, in, out);
+		return;
+	}
+
+	const unsigned int count = batchCount(in);
+	out.offsets.resize(count + 1);
+	for (unsigned int k = 0; k <= count; k++)
+		out.offsets[k] = k * n;
+	out.ids.resize((size_t)count * n);
+
+	vector<unsigned int> slotOf(maxId + 1, n);	// slotOf[0] is n
+	for (unsigned int j = 0; j < n; j++)
+	{
+		if (spec[j] > 0)
+			slotOf[spec[j]] = j;
+	}
+	const int *src = in.ids.data();
+	int *dst = out.ids.data();
+	vector<int> row(n + 1);
+	for (unsigned int k = 0; k < count; k++, dst += n)
+	{
+		memset(row.data(), 0, n * sizeof(int));
+		for (unsigned int i = in.offsets[k]; i < in.offsets[k+1]; i++)
+		{
+			unsigned int id = src[i];
+			row[slotOf[id <= (unsigned int)maxId ? id : 0]] = id;
+		}
+		memcpy(dst, row.data(), n * sizeof(int));
+	}
+}
+
+//---------------------------------------------------------------
+// reconcile server
+// a daemon that keeps indexed specs resident and reconciles file
+// vectors sent to it over a unix domain socket.
+//
+// the protocol is native-endian 32-bit words. a request is
+//	op, specId, count, then count ids
+// and every request gets exactly one response, in order:
+//	status, count, then count ids
+// OP_LOAD_SPEC stores (or replaces) the spec under specId and
+// answers with no ids. specs are indexed through a SpecIndexCache,
+// so loading a spec version that is already resident (under any
+// id) doesn't index it again. OP_RECONCILE answers with the reconciled
+// file vector. OP_DROP_SPEC forgets specId. OP_SHUTDOWN stops the
+// server and disconnects every other client.
+//
+// at most MaxServerSpecs ids are resident at once. loading a new id
+// past that answers ST_TOO_MANY_SPECS; replacing an existing id or
+// dropping one first always works.
+//
+// clients may pipeline: send any number of requests before
+// reading the responses. the server drains everything already
+// buffered before it flushes, so a pipelined batch is answered
+// with as few writes as possible.
+//---------------------------------------------------------------
+enum {
+	OP_LOAD_SPEC = 1,
+	OP_RECONCILE = 2,
+	OP_SHUTDOWN = 3,
+	OP_DROP_SPEC = 4
+};
+
+enum {
+	ST_OK = 0,
+	ST_UNKNOWN_SPEC = 1,
+	ST_BAD_REQUEST = 2,
+	ST_TOO_MANY_SPECS = 3
+};
+
+// refuse anything bigger than this rather than trying to allocate it
+const uint32_t MaxWireCount = 64 * 1024 * 1024;
+const size_t MaxServerSpecs = 4096;
+
+struct ReconcileServer {
+	int listenFd;
+	atomic<bool> stopping;
+	mutex specLock;
+	map<uint32_t, shared_ptr<const SpecIndex> > specs;
+	SpecIndexCache cache;
+	mutex clientLock;
+	set<int> clients;	// open connection fds, for shutdown
+};
+
+// one connection's thread. done is set as the thread's last act, so
+// the accept loop can join it without waiting.
+struct ServerWorker {
+	thread t;
+	atomic<bool> done;
+};
+
+bool
+writeFull(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	while (len)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+bool
+readFull(int fd, void *buf, size_t len)
+{
+	char *p = (char *)buf;
+	while (len)
+	{
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+int
+openServerSocket(const char *path)
+{
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(fd, 16) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int
+connectServerSocket(const char *path)
+{
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void
+appendResponse(string &out, uint32_t status, const vector<int> &ids)
+{
+	uint32_t hdr[2] = { status, (uint32_t)ids.size() };
+	out.append((const char *)hdr, sizeof(hdr));
+	if (ids.size())
+		out.append((const char *)&ids[0], ids.size() * sizeof(int));
+}
+
+// handle one complete request. returns false on OP_SHUTDOWN.
+bool
+serveRequest(ReconcileServer &srv, uint32_t op, uint32_t specId
+		, vector<int> &ids, string &out)
+{
+	vector<int> none;
+	if (op == OP_LOAD_SPEC)
+	{
+		shared_ptr<const SpecIndex> si = getSpecIndex(srv.cache, ids);
+		lock_guard<mutex> lk(srv.specLock);
+		if (srv.specs.size() >= MaxServerSpecs && !srv.specs.count(specId))
+			appendResponse(out, ST_TOO_MANY_SPECS, none);
+		else
+		{
+			srv.specs[specId] = si;
+			appendResponse(out, ST_OK, none);
+		}
+	}
+	else if (op == OP_DROP_SPEC)
+	{
+		lock_guard<mutex> lk(srv.specLock);
+		if (srv.specs.erase(specId))
+			appendResponse(out, ST_OK, none);
+		else
+			appendResponse(out, ST_UNKNOWN_SPEC, none);
+	}
+	else if (op == OP_RECONCILE)
+	{
+		shared_ptr<const SpecIndex> si;
+		{
+			lock_guard<mutex> lk(srv.specLock);
+			map<uint32_t, shared_ptr<const SpecIndex> >::iterator it;
+			it = srv.specs.find(specId);
+			if (it != srv.specs.end())
+				si = it->second;
+		}
+		if (!si)
+			appendResponse(out, ST_UNKNOWN_SPEC, none);
+		else
+		{
+			reconcileIndexed(*si, ids);
+			appendResponse(out, ST_OK, ids);
+		}
+	}
+	else if (op == OP_SHUTDOWN)
+	{
+		appendResponse(out, ST_OK, none);
+		return false;
+	}
+	else
+		appendResponse(out, ST_BAD_REQUEST, none);
+	return true;
+}
+
+void
+serveConnection(ReconcileServer &srv, int fd, atomic<bool> &done)
+{
+	string in;
+	string out;
+	size_t used = 0;
+	bool open = true;
+	bool stop = false;
+	while (open)
+	{
+		char buf[64 * 1024];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		in.append(buf, n);
+
+		// answer every complete request we have, then flush once
+		const size_t hdrLen = 3 * sizeof(uint32_t);
+		while (open && in.size() - used >= hdrLen)
+		{
+			uint32_t hdr[3];
+			memcpy(hdr, in.data() + used, hdrLen);
+			if (hdr[2] > MaxWireCount)
+			{
+				open = false;
+				break;
+			}
+			size_t need = hdrLen + hdr[2] * sizeof(int);
+			if (in.size() - used < need)
+				break;
+			vector<int> ids(hdr[2]);
+			if (hdr[2])
+				memcpy(&ids[0], in.data() + used + hdrLen
+						, hdr[2] * sizeof(int));
+			used += need;
+			if (!serveRequest(srv, hdr[0], hdr[1], ids, out))
+			{
+				stop = true;
+				open = false;
+			}
+		}
+		in.erase(0, used);
+		used = 0;
+		if (out.size() && !writeFull(fd, out.data(), out.size()))
+			break;
+		out.clear();
+	}
+	// stop only once our own answers are out, since stopping
+	// shuts down every client socket, this one included
+	if (stop)
+	{
+		srv.stopping = true;
+		shutdown(srv.listenFd, SHUT_RDWR);
+	}
+	{
+		// drop out of the set before the fd number can be reused
+		lock_guard<mutex> lk(srv.clientLock);
+		srv.clients.erase(fd);
+	}
+	close(fd);
+	done = true;
+}
+
+// join the workers whose connections have closed
+void
+reapWorkers(list<ServerWorker> &workers)
+{
+	list<ServerWorker>::iterator it = workers.begin();
+	while (it != workers.end())
+	{
+		if (it->done)
+		{
+			it->t.join();
+			it = workers.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+// accept connections until someone sends OP_SHUTDOWN. peakWorkers,
+// if given, gets the most connection threads held at once.
+void
+runReconcileServer(int listenFd, unsigned int *peakWorkers = NULL)
+{
+	ReconcileServer srv;
+	srv.listenFd = listenFd;
+	srv.stopping = false;
+	initSpecIndexCache(srv.cache, 64);
+	list<ServerWorker> workers;
+	while (!srv.stopping)
+	{
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		{
+			lock_guard<mutex> lk(srv.clientLock);
+			srv.clients.insert(fd);
+		}
+		// threads are only held for connections still open (or
+		// closed since the last accept)
+		reapWorkers(workers);
+		workers.emplace_back();
+		ServerWorker &sw = workers.back();
+		sw.done = false;
+		sw.t = thread(serveConnection, ref(srv), fd, ref(sw.done));
+		if (peakWorkers && workers.size() > *peakWorkers)
+			*peakWorkers = workers.size();
+	}
+	{
+		// idle clients would otherwise sit in read() forever. waking
+		// them makes their read return 0 and their thread exit
+		lock_guard<mutex> lk(srv.clientLock);
+		for (set<int>::iterator it = srv.clients.begin()
+				; it != srv.clients.end(); ++it)
+			shutdown(*it, SHUT_RDWR);
+	}
+	for (list<ServerWorker>::iterator it = workers.begin()
+			; it != workers.end(); ++it)
+		it->t.join();
+	close(listenFd);
+}
+
+//---------------------------------------------------------------
+// reconcile client
+// the bundled client for the server above. send* only queues the
+// request; flush() puts everything queued on the wire, and
+// readResponse() collects the answers in the order they were sent.
+//---------------------------------------------------------------
+struct ReconcileClient {
+	int fd;
+	string out;
+};
+
+bool
+clientConnect(ReconcileClient &c, const char *path)
+{
+	c.out.clear();
+	c.fd = connectServerSocket(path);
+	return c.fd >= 0;
+}
+
+void
+clientSend(ReconcileClient &c, uint32_t op, uint32_t specId
+		, const vector<int> &ids)
+{
+	uint32_t hdr[3] = { op, specId, (uint32_t)ids.size() };
+	c.out.append((const char *)hdr, sizeof(hdr));
+	if (ids.size())
+		c.out.append((const char *)&ids[0], ids.size() * sizeof(int));
+}
+
+bool
+clientFlush(ReconcileClient &c)
+{
+	bool ok = writeFull(c.fd, c.out.data(), c.out.size());
+	c.out.clear();
+	return ok;
+}
+
+bool
+clientReadResponse(ReconcileClient &c, uint32_t &status, vector<int> &ids)
+{
+	uint32_t hdr[2];
+	if (!readFull(c.fd, hdr, sizeof(hdr)) || hdr[1] > MaxWireCount)
+		return false;
+	status = hdr[0];
+	ids.resize(hdr[1]);
+	if (hdr[1] == 0)
+		return true;
+	return readFull(c.fd, &ids[0], hdr[1] * sizeof(int));
+}
+
+void
+clientClose(ReconcileClient &c)
+{
+	if (c.fd >= 0)
+		close(c.fd);
+	c.fd = -1;
+}
+
+// seqmodify client <socket> <spec> <file> [<file> ...]
+// spec and files are comma separated, like the test program uses
+int
+runClientCommand(int argc, char **argv)
+{
+	ReconcileClient c;
+	if (!clientConnect(c, argv[2]))
+	{
+		printf("cannot connect to %s\n", argv[2]);
+		return 1;
+	}
+	const uint32_t specId = 1;
+	vector<int> vec;
+	loadVec(vec, argv[3]);
+	clientSend(c, OP_LOAD_SPEC, specId, vec);
+	for (int i = 4; i < argc; i++)
+	{
+		loadVec(vec, argv[i]);
+		clientSend(c, OP_RECONCILE, specId, vec);
+	}
+	clientFlush(c);
+
+	int rc = 0;
+	uint32_t status;
+	for (int i = 3; i < argc; i++)
+	{
+		if (!clientReadResponse(c, status, vec) || status != ST_OK)
+		{
+			printf("request %d failed\n", i - 3);
+			rc = 1;
+			break;
+		}
+		if (i > 3)
+			logPossibles(vec, argv[i]);
+	}
+	clientClose(c);
+	return rc;
+}
+
+//---------------------------------------------------------------
+// capture files
+// on disk a file vector is just its ids, as native-endian 32-bit
+// ints, one per slot.
+//---------------------------------------------------------------
+bool
+readCaptureFile(const char *path, vector<int> &w)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	bool ok = (fstat(fd, &st) == 0 && st.st_size % sizeof(int) == 0);
+	if (ok)
+	{
+		w.resize(st.st_size / sizeof(int));
+		ok = w.empty() || readFull(fd, w.data(), st.st_size);
+	}
+	close(fd);
+	return ok;
+}
+
+bool
+writeCaptureFile(const char *path, const vector<int> &w)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool ok = w.empty() || writeFull(fd, w.data(), w.size() * sizeof(int));
+	if (close(fd) != 0)
+		ok = false;
+	return ok;
+}
+
+//---------------------------------------------------------------
+// batched capture file i/o
+// resyncing thousands of small capture files one open/read/close
+// and open/write/close at a time is mostly syscall overhead. this
+// layer takes a whole batch of files through each step together:
+// with io_uring, every open (plus statx for the size), every read
+// or write, and every close in the batch goes in as one submission,
+// so a batch costs a few io_uring_enter calls however many files
+// are in it. without io_uring (old kernel, or not linux) the same
+// operations are done one by one with open/fstat/pread/pwrite.
+//
+// the ring is driven by hand from <linux/io_uring.h>; there is no
+// liburing dependency.
+//---------------------------------------------------------------
+enum {
+	IO_OPEN,
+	IO_STAT,
+	IO_READ,
+	IO_WRITE,
+	IO_FSYNC,
+	IO_CLOSE
+};
+
+struct IOOp {
+	int op;
+	int fd;
+	const char *path;	// IO_OPEN, IO_STAT
+	int flags;		// IO_OPEN
+	void *buf;		// IO_READ, IO_WRITE
+	size_t len;
+	uint64_t off;		// IO_READ, IO_WRITE: file offset
+	uint64_t size;		// IO_STAT result
+#ifdef HAVE_IO_URING
+	struct statx stx;	// where the ring's statx lands
+#endif
+	long result;		// >= 0 ok (fd, bytes), else -errno
+};
+
+struct CaptureIO {
+	bool uring;
+	int ringFd;
+	unsigned int entries;
+	unsigned int enterCalls;	// io_uring_enter calls made so far
+	uint64_t bytesWritten;
+#ifdef HAVE_IO_URING
+	void *sqRing;
+	void *cqRing;
+	size_t sqRingLen;
+	size_t cqRingLen;
+	struct io_uring_sqe *sqes;
+	size_t sqesLen;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+#endif
+};
+
+// set up the ring; falls back to plain syscalls if it can't (or if
+// allowUring is false)
+void
+initCaptureIO(CaptureIO &io, unsigned int entries, bool allowUring)
+{
+	io.uring = false;
+	io.ringFd = -1;
+	io.entries = entries;
+	io.enterCalls = 0;
+	io.bytesWritten = 0;
+#ifdef HAVE_IO_URING
+	if (!allowUring)
+		return;
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0)
+		return;
+	// openat/statx/close need 5.6, which is also when this showed up
+	if (!(p.features & IORING_FEAT_NODROP))
+	{
+		close(fd);
+		return;
+	}
+	io.sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	io.cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		io.sqRingLen = io.cqRingLen = max(io.sqRingLen, io.cqRingLen);
+	io.sqRing = mmap(NULL, io.sqRingLen, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (io.sqRing == MAP_FAILED)
+	{
+		close(fd);
+		return;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		io.cqRing = io.sqRing;
+	else
+	{
+		io.cqRing = mmap(NULL, io.cqRingLen, PROT_READ | PROT_WRITE
+				, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (io.cqRing == MAP_FAILED)
+		{
+			munmap(io.sqRing, io.sqRingLen);
+			close(fd);
+			return;
+		}
+	}
+	io.sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+	io.sqes = (struct io_uring_sqe *)mmap(NULL, io.sqesLen
+			, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE
+			, fd, IORING_OFF_SQES);
+	if (io.sqes == MAP_FAILED)
+	{
+		if (io.cqRing != io.sqRing)
+			munmap(io.cqRing, io.cqRingLen);
+		munmap(io.sqRing, io.sqRingLen);
+		close(fd);
+		return;
+	}
+	char *sq = (char *)io.sqRing;
+	char *cq = (char *)io.cqRing;
+	io.sqTail = (unsigned *)(sq + p.sq_off.tail);
+	io.sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+	io.sqArray = (unsigned *)(sq + p.sq_off.array);
+	io.cqHead = (unsigned *)(cq + p.cq_off.head);
+	io.cqTail = (unsigned *)(cq + p.cq_off.tail);
+	io.cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+	io.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	io.entries = p.sq_entries;
+	io.ringFd = fd;
+	io.uring = true;
+#endif
+}
+
+void
+closeCaptureIO(CaptureIO &io)
+{
+#ifdef HAVE_IO_URING
+	if (io.uring)
+	{
+		munmap(io.sqes, io.sqesLen);
+		if (io.cqRing != io.sqRing)
+			munmap(io.cqRing, io.cqRingLen);
+		munmap(io.sqRing, io.sqRingLen);
+		close(io.ringFd);
+	}
+#endif
+	io.uring = false;
+	io.ringFd = -1;
+}
+
+// a read or write that came back short: carry on from where it
+// stopped. it stays short only at end of file or on an error.
+void
+finishShortIO(IOOp &op)
+{
+	size_t done = op.result;
+	while (done < op.len)
+	{
+		char *p = (char *)op.buf + done;
+		ssize_t n = (op.op == IO_READ)
+				? pread(op.fd, p, op.len - done, op.off + done)
+				: pwrite(op.fd, p, op.len - done, op.off + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	op.result = done;
+}
+
+// do one op with ordinary syscalls
+void
+runIOOpSync(IOOp &op)
+{
+	ssize_t n = -1;
+	switch (op.op)
+	{
+	case IO_OPEN:
+		n = open(op.path, op.flags, 0644);
+		break;
+	case IO_STAT:
+	{
+		struct stat st;
+		n = stat(op.path, &st);
+		if (n == 0)
+			op.size = st.st_size;
+		break;
+	}
+	case IO_READ:
+		n = pread(op.fd, op.buf, op.len, op.off);
+		break;
+	case IO_WRITE:
+		n = pwrite(op.fd, op.buf, op.len, op.off);
+		break;
+	case IO_FSYNC:
+		n = fdatasync(op.fd);
+		break;
+	case IO_CLOSE:
+		n = close(op.fd);
+		break;
+	}
+	op.result = (n < 0) ? -errno : n;
+	if ((op.op == IO_READ || op.op == IO_WRITE) && n > 0
+			&& (size_t)n < op.len)
+		finishShortIO(op);
+}
+
+#ifdef HAVE_IO_URING
+void
+prepSqe(struct io_uring_sqe *sqe, IOOp &op, uint64_t tag)
+{
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = tag;
+	switch (op.op)
+	{
+	case IO_OPEN:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)op.path;
+		sqe->len = 0644;
+		sqe->open_flags = op.flags;
+		break;
+	case IO_STAT:
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)(uintptr_t)op.path;
+		sqe->len = STATX_SIZE;
+		sqe->off = (uint64_t)(uintptr_t)&op.stx;
+		break;
+	case IO_READ:
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = op.fd;
+		sqe->addr = (uint64_t)(uintptr_t)op.buf;
+		sqe->len = op.len;
+		sqe->off = op.off;
+		break;
+	case IO_WRITE:
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = op.fd;
+		sqe->addr = (uint64_t)(uintptr_t)op.buf;
+		sqe->len = op.len;
+		sqe->off = op.off;
+		break;
+	case IO_FSYNC:
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = op.fd;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+		break;
+	case IO_CLOSE:
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = op.fd;
+		break;
+	}
+}
+#endif
+
+// run every op in the list; they must not depend on each other.
+// a ring's worth at a time goes in with a single io_uring_enter
+// that also waits for all of them to complete.
+void
+runIOOps(CaptureIO &io, vector<IOOp> &ops)
+{
+	if (!io.uring)
+	{
+		for (unsigned int i = 0; i < ops.size(); i++)
+			runIOOpSync(ops[i]);
+		return;
+	}
+#ifdef HAVE_IO_URING
+	for (unsigned int base = 0; base < ops.size(); base += io.entries)
+	{
+		unsigned int n = min((unsigned int)ops.size() - base, io.entries);
+		unsigned int tail = *io.sqTail;
+		for (unsigned int i = 0; i < n; i++)
+		{
+			unsigned int idx = (tail + i) & *io.sqMask;
+			prepSqe(&io.sqes[idx], ops[base + i], base + i);
+			io.sqArray[idx] = idx;
+		}
+		__atomic_store_n(io.sqTail, tail + n, __ATOMIC_RELEASE);
+
+		unsigned int done = 0;
+		unsigned int submit = n;
+		vector<char> reaped(n, 0);
+		bool failed = false;
+		while (done < n)
+		{
+			// once enter has failed, only wait for what's in flight
+			unsigned int want = failed ? n - submit - done : n - done;
+			if (want == 0)
+				break;
+			int r = syscall(__NR_io_uring_enter, io.ringFd
+					, failed ? 0 : submit, want
+					, IORING_ENTER_GETEVENTS, NULL, 0);
+			io.enterCalls++;
+			if (r < 0 && errno != EINTR)
+			{
+				if (failed)
+					break;
+				failed = true;
+				continue;
+			}
+			if (r > 0 && !failed)
+				submit -= min((unsigned int)r, submit);
+			unsigned int head = *io.cqHead;
+			while (head != __atomic_load_n(io.cqTail, __ATOMIC_ACQUIRE))
+			{
+				struct io_uring_cqe *cqe = &io.cqes[head & *io.cqMask];
+				ops[cqe->user_data].result = cqe->res;
+				reaped[cqe->user_data - base] = 1;
+				head++;
+				done++;
+			}
+			__atomic_store_n(io.cqHead, head, __ATOMIC_RELEASE);
+		}
+		if (failed)
+		{
+			// the ring is in an unknown state: sqes we queued may
+			// still be sitting in it, and a later call must never
+			// reap their completions into its own ops. retire it
+			// and do everything not yet reaped by hand.
+			closeCaptureIO(io);
+			for (unsigned int i = base; i < ops.size(); i++)
+			{
+				if (i >= base + n || !reaped[i - base])
+					runIOOpSync(ops[i]);
+			}
+		}
+		for (unsigned int i = base; i < base + n; i++)
+		{
+			IOOp &op = ops[i];
+			if (failed && !reaped[i - base])
+				continue;
+			// the kernel didn't know an opcode: do those by hand
+			if (op.result == -EINVAL || op.result == -EOPNOTSUPP)
+				runIOOpSync(op);
+			else if (op.op == IO_STAT && op.result == 0)
+				op.size = op.stx.stx_size;
+			else if ((op.op == IO_READ || op.op == IO_WRITE)
+					&& op.result > 0 && (size_t)op.result < op.len)
+				finishShortIO(op);
+		}
+		if (failed)
+			return;
+	}
+#endif
+}
+
+IOOp
+makeIOOp(int op, int fd, const char *path)
+{
+	IOOp o;
+	memset(&o, 0, sizeof(o));
+	o.op = op;
+	o.fd = fd;
+	o.path = path;
+	o.result = -EBADF;
+	return o;
+}
+
+// close every fd that opened (ops[i].result of the opens)
+void
+closeBatch(CaptureIO &io, vector<IOOp> &opens)
+{
+	vector<IOOp> ops;
+	for (unsigned int i = 0; i < opens.size(); i++)
+	{
+		if (opens[i].op == IO_OPEN && opens[i].result >= 0)
+			ops.push_back(makeIOOp(IO_CLOSE, opens[i].result, NULL));
+	}
+	runIOOps(io, ops);
+}
+
+// read a batch of capture files. ok[k] says whether ws[k] was read.
+void
+readCaptureFiles(CaptureIO &io, const vector<string> &paths
+		, vector<vector<int> > &ws, vector<char> &ok)
+{
+	unsigned int n = paths.size();
+	ws.assign(n, vector<int>());
+	ok.assign(n, 0);
+
+	// open and size every file
+	vector<IOOp> ops;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		ops.push_back(makeIOOp(IO_OPEN, -1, paths[k].c_str()));
+		ops.back().flags = O_RDONLY;
+		ops.push_back(makeIOOp(IO_STAT, -1, paths[k].c_str()));
+	}
+	runIOOps(io, ops);
+
+	// read them
+	vector<IOOp> reads;
+	vector<unsigned int> who;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		IOOp &o = ops[2*k];
+		IOOp &st = ops[2*k + 1];
+		if (o.result < 0 || st.result < 0 || st.size % sizeof(int))
+			continue;
+		ws[k].resize(st.size / sizeof(int));
+		ok[k] = 1;
+		if (ws[k].empty())
+			continue;
+		reads.push_back(makeIOOp(IO_READ, o.result, NULL));
+		reads.back().buf = ws[k].data();
+		reads.back().len = st.size;
+		who.push_back(k);
+	}
+	runIOOps(io, reads);
+	for (unsigned int i = 0; i < reads.size(); i++)
+	{
+		// a short read here means the file changed under us
+		if (reads[i].result != (long)reads[i].len)
+			ok[who[i]] = 0;
+	}
+	closeBatch(io, ops);
+}
+
+// write a batch of capture files, replacing their contents
+void
+writeCaptureFiles(CaptureIO &io, const vector<string> &paths
+		, const vector<vector<int> > &ws, vector<char> &ok)
+{
+	unsigned int n = paths.size();
+	vector<IOOp> ops;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		ops.push_back(makeIOOp(IO_OPEN, -1, paths[k].c_str()));
+		ops.back().flags = O_WRONLY | O_CREAT | O_TRUNC;
+	}
+	runIOOps(io, ops);
+
+	ok.assign(n, 0);
+	vector<IOOp> writes;
+	vector<unsigned int> who;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		if (ops[k].result < 0)
+			continue;
+		ok[k] = 1;
+		if (ws[k].empty())
+			continue;
+		writes.push_back(makeIOOp(IO_WRITE, ops[k].result, NULL));
+		writes.back().buf = (void *)ws[k].data();
+		writes.back().len = ws[k].size() * sizeof(int);
+		who.push_back(k);
+	}
+	runIOOps(io, writes);
+	for (unsigned int i = 0; i < writes.size(); i++)
+	{
+		// runIOOps has already finished any short write, so one
+		// still short failed
+		IOOp &w = writes[i];
+		if (w.result != (long)w.len)
+			ok[who[i]] = 0;
+		io.bytesWritten += w.result > 0 ? w.result : 0;
+	}
+	closeBatch(io, ops);
+}
+
+// the byte ranges of a capture file that differ between its old
+// and new contents. neighbouring ranges closer than DirtyMergeGap
+// bytes are merged, since one slightly longer write beats two.
+// appendOnly is set when the new contents are the old ones with
+// slots added at the end, so the file only needs appending to.
+const size_t DirtyMergeGap = 64;
+
+struct DirtyRange {
+	size_t off;
+	size_t len;
+};
+
+void
+diffFileVecs(const vector<int> &oldW, const vector<int> &newW
+		, vector<DirtyRange> &ranges, bool &appendOnly)
+{
+	ranges.clear();
+	size_t common = min(oldW.size(), newW.size());
+	for (size_t i = 0; i < common; i++)
+	{
+		if (oldW[i] == newW[i])
+			continue;
+		size_t j = i + 1;
+		while (j < common && oldW[j] != newW[j])
+			j++;
+		size_t off = i * sizeof(int);
+		if (ranges.size() && off - (ranges.back().off + ranges.back().len)
+				< DirtyMergeGap)
+			ranges.back().len = j * sizeof(int) - ranges.back().off;
+		else
+		{
+			DirtyRange r = { off, (j - i) * sizeof(int) };
+			ranges.push_back(r);
+		}
+		i = j;
+	}
+	appendOnly = ranges.empty() && newW.size() > oldW.size();
+	if (newW.size() > oldW.size())
+	{
+		DirtyRange r = { common * sizeof(int)
+			, (newW.size() - common) * sizeof(int) };
+		ranges.push_back(r);
+	}
+}
+
+// write back only what changed between olds[k] and news[k]. files
+// that didn't change aren't touched, pure tail extensions are opened
+// for append, and files that got shorter are truncated. with sync
+// set, the changed files are flushed to disk before returning.
+void
+writeCaptureChanges(CaptureIO &io, const vector<string> &paths
+		, const vector<vector<int> > &olds, const vector<vector<int> > &news
+		, vector<char> &ok, bool sync = false)
+{
+	unsigned int n = paths.size();
+	ok.assign(n, 1);
+	vector<vector<DirtyRange> > ranges(n);
+	vector<char> appendOnly(n, 0);
+	vector<IOOp> ops;
+	vector<unsigned int> who;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		bool append;
+		diffFileVecs(olds[k], news[k], ranges[k], append);
+		appendOnly[k] = append;
+		if (ranges[k].empty() && olds[k].size() == news[k].size())
+			continue;
+		ops.push_back(makeIOOp(IO_OPEN, -1, paths[k].c_str()));
+		ops.back().flags = O_WRONLY | (append ? O_APPEND : 0);
+		who.push_back(k);
+	}
+	runIOOps(io, ops);
+
+	vector<IOOp> writes;
+	vector<unsigned int> writeWho;
+	for (unsigned int i = 0; i < ops.size(); i++)
+	{
+		unsigned int k = who[i];
+		int fd = ops[i].result;
+		if (fd < 0)
+		{
+			ok[k] = 0;
+			continue;
+		}
+		if (news[k].size() < olds[k].size()
+				&& ftruncate(fd, news[k].size() * sizeof(int)) != 0)
+			ok[k] = 0;
+		for (unsigned int r = 0; r < ranges[k].size(); r++)
+		{
+			writes.push_back(makeIOOp(IO_WRITE, fd, NULL));
+			writes.back().buf = (char *)news[k].data() + ranges[k][r].off;
+			writes.back().len = ranges[k][r].len;
+			writes.back().off = ranges[k][r].off;
+			writeWho.push_back(k);
+		}
+	}
+	runIOOps(io, writes);
+	for (unsigned int i = 0; i < writes.size(); i++)
+	{
+		IOOp &w = writes[i];
+		if (w.result != (long)w.len)
+			ok[writeWho[i]] = 0;
+		io.bytesWritten += w.result > 0 ? w.result : 0;
+	}
+	if (sync)
+	{
+		vector<IOOp> syncs;
+		for (unsigned int i = 0; i < ops.size(); i++)
+			if (ops[i].result >= 0)
+				syncs.push_back(makeIOOp(IO_FSYNC, ops[i].result, NULL));
+		runIOOps(io, syncs);
+		unsigned int j = 0;
+		for (unsigned int i = 0; i < ops.size(); i++)
+			if (ops[i].result >= 0 && syncs[j++].result != 0)
+				ok[who[i]] = 0;
+	}
+	closeBatch(io, ops);
+}
+
+// reconcile capture files in place, batchSize files at a time.
+// returns how many were read, reconciled and written back.
+int
+resyncFilesBatched(CaptureIO &io, const SpecIndex &si
+		, const vector<string> &paths, unsigned int batchSize)
+{
+	int written = 0;
+	for (unsigned int base = 0; base < paths.size(); base += batchSize)
+	{
+		unsigned int end = min((unsigned int)paths.size(), base + batchSize);
+		vector<string> batch(paths.begin() + base, paths.begin() + end);
+		vector<vector<int> > ws;
+		vector<char> readOk, writeOk;
+		readCaptureFiles(io, batch, ws, readOk);
+
+		vector<string> outPaths;
+		vector<vector<int> > olds;
+		vector<vector<int> > news;
+		for (unsigned int k = 0; k < batch.size(); k++)
+		{
+			if (!readOk[k])
+				continue;
+			outPaths.push_back(batch[k]);
+			news.push_back(ws[k]);
+			reconcileIndexed(si, news.back());
+			olds.push_back(std::move(ws[k]));
+		}
+		writeCaptureChanges(io, outPaths, olds, news, writeOk);
+		for (unsigned int k = 0; k < writeOk.size(); k++)
+			written += writeOk[k];
+	}
+	return written;
+}
+
+//---------------------------------------------------------------
+// resync journal
+// a write-ahead journal that makes resyncing capture files crash
+// safe. before any file is touched, a BEGIN record goes into the
+// journal holding the edit script fixVectors used (for redo) and
+// the old bytes of every range the write will change (for undo).
+// once the file's changes are on disk a COMMIT record follows.
+// records for a whole batch of files share one fsync of the
+// journal, and the journal is emptied whenever nothing is left
+// uncommitted.
+//
+// after a crash, recoverJournal only looks at files with a BEGIN
+// but no COMMIT. each one is put back to its old contents from the
+// undo ranges, and then (unless rolling back) the edit script is
+// replayed over it and the changed ranges written again. nothing
+// else needs to be rescanned.
+//
+// records are native-endian, like the capture files:
+//	header	magic, type, seq, body length, fnv-1a of the body
+//	BEGIN	path length, path, old slots, new slots,
+//		script length, script, undo count,
+//		then per undo range: offset, length, old bytes
+// the header's body length and everything in a BEGIN that's sized
+// by the file (slots, offsets, lengths, counts) is 64 bits, so
+// files over 4 GiB journal like any other.
+//	COMMIT	empty body; seq names the BEGIN
+// a record that's cut short or fails its checksum ends the journal.
+//---------------------------------------------------------------
+const uint32_t JournalMagic = 0x4a514553;	// "SEQJ"
+
+enum {
+	JR_BEGIN = 1,
+	JR_COMMIT = 2
+};
+
+struct JournalHeader {
+	uint32_t magic;
+	uint32_t type;
+	uint64_t seq;
+	uint64_t bodyLen;
+	uint32_t sum;
+	uint32_t pad;
+};
+
+struct Journal {
+	int fd;
+	uint64_t nextSeq;
+	vector<char> pending;	// records not yet written out
+	unsigned int uncommitted;
+	unsigned int syncs;	// fdatasync calls on the journal
+};
+
+uint32_t
+journalSum(const char *p, size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)p[i]) * 16777619u;
+	return h;
+}
+
+void
+putJournalBytes(vector<char> &out, const void *p, size_t len)
+{
+	out.insert(out.end(), (const char *)p, (const char *)p + len);
+}
+
+void
+putJournalU32(vector<char> &out, uint32_t v)
+{
+	putJournalBytes(out, &v, sizeof(v));
+}
+
+void
+putJournalU64(vector<char> &out, uint64_t v)
+{
+	putJournalBytes(out, &v, sizeof(v));
+}
+
+void
+putJournalRecord(vector<char> &out, uint32_t type, uint64_t seq
+		, const vector<char> &body)
+{
+	JournalHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = JournalMagic;
+	h.type = type;
+	h.seq = seq;
+	h.bodyLen = body.size();
+	h.sum = journalSum(body.data(), body.size());
+	putJournalBytes(out, &h, sizeof(h));
+	putJournalBytes(out, body.data(), body.size());
+}
+
+// the journal must have been recovered (so is empty) before it's
+// opened for new work
+bool
+openJournal(Journal &j, const char *path)
+{
+	j.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+	j.nextSeq = 1;
+	j.pending.clear();
+	j.uncommitted = 0;
+	j.syncs = 0;
+	return j.fd >= 0;
+}
+
+void
+closeJournal(Journal &j)
+{
+	if (j.fd >= 0)
+		close(j.fd);
+	j.fd = -1;
+}
+
+// queue a BEGIN for rewriting path from old to neu with script.
+// returns the seq to commit it with.
+uint64_t
+journalBegin(Journal &j, const string &path, const vector<int> &old
+		, const vector<int> &neu, const vector<int> &script)
+{
+	vector<DirtyRange> ranges;
+	bool appendOnly;
+	diffFileVecs(old, neu, ranges, appendOnly);
+	// only bytes the old file had need saving: anything written
+	// past its end goes again when it's truncated back. a shrink
+	// needs the part it cuts off.
+	size_t oldBytes = old.size() * sizeof(int);
+	vector<DirtyRange> undo;
+	for (unsigned int r = 0; r < ranges.size(); r++)
+	{
+		if (ranges[r].off >= oldBytes)
+			continue;
+		DirtyRange u = { ranges[r].off, min(ranges[r].len
+			, oldBytes - ranges[r].off) };
+		undo.push_back(u);
+	}
+	if (neu.size() < old.size())
+	{
+		DirtyRange u = { neu.size() * sizeof(int)
+			, (old.size() - neu.size()) * sizeof(int) };
+		undo.push_back(u);
+	}
+
+	vector<char> body;
+	putJournalU32(body, path.size());
+	putJournalBytes(body, path.data(), path.size());
+	putJournalU64(body, old.size());
+	putJournalU64(body, neu.size());
+	putJournalU64(body, script.size());
+	putJournalBytes(body, script.data(), script.size() * sizeof(int));
+	putJournalU64(body, undo.size());
+	for (unsigned int u = 0; u < undo.size(); u++)
+	{
+		putJournalU64(body, undo[u].off);
+		putJournalU64(body, undo[u].len);
+		putJournalBytes(body, (const char *)old.data() + undo[u].off
+				, undo[u].len);
+	}
+	uint64_t seq = j.nextSeq++;
+	putJournalRecord(j.pending, JR_BEGIN, seq, body);
+	j.uncommitted++;
+	return seq;
+}
+
+void
+journalCommit(Journal &j, uint64_t seq)
+{
+	putJournalRecord(j.pending, JR_COMMIT, seq, vector<char>());
+	j.uncommitted--;
+}
+
+// write out everything queued and make it durable
+bool
+journalSync(Journal &j)
+{
+	if (j.pending.empty())
+		return true;
+	bool ok = writeFull(j.fd, j.pending.data(), j.pending.size())
+		&& fdatasync(j.fd) == 0;
+	j.syncs++;
+	j.pending.clear();
+	return ok;
+}
+
+// drop the journal's contents once nothing in it is still needed
+bool
+journalCheckpoint(Journal &j)
+{
+	if (j.uncommitted || !j.pending.empty())
+		return false;
+	return ftruncate(j.fd, 0) == 0;
+}
+
+struct JournalEntry {
+	string path;
+	uint64_t oldLen;
+	uint64_t newLen;
+	vector<int> script;
+	vector<DirtyRange> undo;
+	vector<char> undoBytes;	// undo ranges' old bytes, back to back
+};
+
+// pull one field out of a record body, failing past its end
+bool
+getJournalBytes(const vector<char> &body, size_t &at, void *p, size_t len)
+{
+	if (len > body.size() - at)
+		return false;
+	if (len)
+		memcpy(p, body.data() + at, len);
+	at += len;
+	return true;
+}
+
+bool
+parseJournalBegin(const vector<char> &body, JournalEntry &e)
+{
+	size_t at = 0;
+	uint32_t pathLen = 0;
+	if (!getJournalBytes(body, at, &pathLen, sizeof(pathLen))
+			|| pathLen > body.size() - at)
+		return false;
+	e.path.assign(body.data() + at, pathLen);
+	at += pathLen;
+	uint64_t n = 0;
+	if (!getJournalBytes(body, at, &e.oldLen, sizeof(e.oldLen))
+			|| !getJournalBytes(body, at, &e.newLen, sizeof(e.newLen))
+			|| !getJournalBytes(body, at, &n, sizeof(n))
+			|| n > (body.size() - at) / sizeof(int))
+		return false;
+	e.script.resize(n);
+	getJournalBytes(body, at, e.script.data(), n * sizeof(int));
+	if (!getJournalBytes(body, at, &n, sizeof(n)))
+		return false;
+	for (uint64_t u = 0; u < n; u++)
+	{
+		uint64_t off, len;
+		if (!getJournalBytes(body, at, &off, sizeof(off))
+				|| !getJournalBytes(body, at, &len, sizeof(len))
+				|| len > body.size() - at)
+			return false;
+		DirtyRange r = { off, len };
+		e.undo.push_back(r);
+		putJournalBytes(e.undoBytes, body.data() + at, len);
+		at += len;
+	}
+	return true;
+}
+
+// put one interrupted file back to its old contents, then unless
+// rolling back, redo its edits. returns 1 if the file was recovered,
+// 0 if it has been deleted since (nothing to restore), -1 on failure.
+int
+recoverJournalEntry(const JournalEntry &e, bool rollback)
+{
+	int fd = open(e.path.c_str(), O_RDWR);
+	if (fd < 0 && errno == ENOENT)
+	{
+		if (DebugLog)
+			printf("journal: %s no longer exists, nothing to restore\n"
+					, e.path.c_str());
+		return 0;
+	}
+	if (fd < 0)
+		return -1;
+	bool ok = true;
+	size_t at = 0;
+	for (unsigned int u = 0; u < e.undo.size() && ok; u++)
+	{
+		ok = pwrite(fd, e.undoBytes.data() + at, e.undo[u].len
+				, e.undo[u].off) == (ssize_t)e.undo[u].len;
+		at += e.undo[u].len;
+	}
+	ok = ok && ftruncate(fd, (off_t)e.oldLen * sizeof(int)) == 0
+		&& fdatasync(fd) == 0;
+	close(fd);
+	if (!ok)
+		return -1;
+	if (rollback)
+		return 1;
+
+	vector<string> paths(1, e.path);
+	vector<vector<int> > olds(1), news;
+	if (!readCaptureFile(e.path.c_str(), olds[0])
+			|| olds[0].size() != e.oldLen)
+		return -1;
+	news = olds;
+	applyEditScript(e.script, news[0]);
+	if (news[0].size() != e.newLen)
+		return -1;
+	CaptureIO io;
+	initCaptureIO(io, 1, false);
+	vector<char> writeOk;
+	writeCaptureChanges(io, paths, olds, news, writeOk, true);
+	closeCaptureIO(io);
+	return writeOk[0] ? 1 : -1;
+}
+
+// redo (or with rollback, undo) every file the journal at path
+// has a BEGIN but no COMMIT for, then empty the journal. returns
+// how many files were recovered, or -1 if any couldn't be (the
+// journal is kept so recovery can be tried again). files deleted
+// since are skipped.
+int
+recoverJournal(const char *path, bool rollback)
+{
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	struct stat st;
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	map<uint64_t, JournalEntry> begun;
+	JournalHeader h;
+	while (readFull(fd, &h, sizeof(h)) && h.magic == JournalMagic
+			&& h.bodyLen <= (uint64_t)st.st_size)
+	{
+		vector<char> body(h.bodyLen);
+		if (!readFull(fd, body.data(), body.size())
+				|| journalSum(body.data(), body.size()) != h.sum)
+			break;
+		if (h.type == JR_COMMIT)
+			begun.erase(h.seq);
+		else if (h.type == JR_BEGIN)
+		{
+			JournalEntry e;
+			if (!parseJournalBegin(body, e))
+				break;
+			begun[h.seq] = e;
+		}
+	}
+
+	int recovered = 0;
+	map<uint64_t, JournalEntry>::iterator it;
+	for (it = begun.begin(); it != begun.end(); it++)
+	{
+		int r = recoverJournalEntry(it->second, rollback);
+		if (r < 0)
+		{
+			close(fd);
+			return -1;
+		}
+		recovered += r;
+	}
+	bool ok = ftruncate(fd, 0) == 0 && fdatasync(fd) == 0;
+	close(fd);
+	return ok ? recovered : -1;
+}
+
+// resyncFilesBatched with a journal: each batch of files is
+// reconciled with fixVectors (or with reconcileMinEdit, if a cost
+// model is given), their BEGINs synced together, the changed
+// ranges written and flushed, then their COMMITs synced together.
+// returns how many files were brought in sync.
+int
+resyncFilesJournaled(CaptureIO &io, Journal &j, const vector<int> &spec
+		, const vector<string> &paths, unsigned int batchSize
+		, const EditCostModel *cm = NULL)
+{
+	bool saved = DebugLog;
+	DebugLog = false;
+	vector<int> a = spec;
+	SpecIndex si;
+	buildSpecIndex(si, spec);
+	int written = 0;
+	for (unsigned int base = 0; base < paths.size(); base += batchSize)
+	{
+		unsigned int end = min((unsigned int)paths.size(), base + batchSize);
+		vector<string> batch(paths.begin() + base, paths.begin() + end);
+		vector<vector<int> > ws;
+		vector<char> readOk, writeOk;
+		readCaptureFiles(io, batch, ws, readOk);
+
+		vector<string> outPaths;
+		vector<vector<int> > olds;
+		vector<vector<int> > news;
+		vector<uint64_t> seqs;
+		for (unsigned int k = 0; k < batch.size(); k++)
+		{
+			if (!readOk[k])
+				continue;
+			vector<int> w = ws[k];
+			vector<int> script;
+			if (cm ? reconcileMinEdit(si, w, *cm, &script) < 0
+					: !fixVectors(a, w, &script))
+				continue;
+			if (w == ws[k])
+			{
+				written++;
+				continue;
+			}
+			seqs.push_back(journalBegin(j, batch[k], ws[k], w, script));
+			outPaths.push_back(batch[k]);
+			news.push_back(std::move(w));
+			olds.push_back(std::move(ws[k]));
+		}
+		if (!journalSync(j))
+			break;
+		writeCaptureChanges(io, outPaths, olds, news, writeOk, true);
+		// a file whose write failed keeps its BEGIN, so the next
+		// recovery finishes it
+		for (unsigned int k = 0; k < writeOk.size(); k++)
+		{
+			if (!writeOk[k])
+				continue;
+			journalCommit(j, seqs[k]);
+			written++;
+		}
+		if (!journalSync(j))
+			break;
+		journalCheckpoint(j);
+	}
+	DebugLog = saved;
+	return written;
+}
+
+//---------------------------------------------------------------
+// resync pipeline
+// resyncing a directory of capture files is mostly waiting on i/o.
+// the pipeline runs read, reconcile and write as three coroutines
+// on a small thread pool, joined by bounded queues: while one file
+// is being reconciled the next is being read and the previous one
+// written. a full queue suspends its producer until the consumer
+// catches up, so at most a few files are ever in memory.
+//
+// the pool is the i/o backend: the blocking reads and writes just
+// occupy a pool thread while the other stages carry on.
+//---------------------------------------------------------------
+struct ThreadPool {
+	mutex lock;
+	condition_variable cv;
+	deque<coroutine_handle<> > ready;
+	vector<thread> threads;
+	bool stopping;
+};
+
+void
+poolWorker(ThreadPool &tp)
+{
+	DebugLog = false;
+	unique_lock<mutex> lk(tp.lock);
+	for (;;)
+	{
+		tp.cv.wait(lk, [&tp]() { return tp.stopping || !tp.ready.empty(); });
+		if (tp.ready.empty())
+			break;
+		coroutine_handle<> h = tp.ready.front();
+		tp.ready.pop_front();
+		lk.unlock();
+		h.resume();
+		lk.lock();
+	}
+}
+
+void
+startPool(ThreadPool &tp, unsigned int n)
+{
+	tp.stopping = false;
+	for (unsigned int i = 0; i < n; i++)
+		tp.threads.push_back(thread(poolWorker, ref(tp)));
+}
+
+void
+poolPost(ThreadPool &tp, coroutine_handle<> h)
+{
+	{
+		lock_guard<mutex> lk(tp.lock);
+		tp.ready.push_back(h);
+	}
+	tp.cv.notify_one();
+}
+
+// finishes whatever is queued, then joins the threads
+void
+stopPool(ThreadPool &tp)
+{
+	{
+		lock_guard<mutex> lk(tp.lock);
+		tp.stopping = true;
+	}
+	tp.cv.notify_all();
+	for (unsigned int i = 0; i < tp.threads.size(); i++)
+		tp.threads[i].join();
+	tp.threads.clear();
+}
+
+// co_await this to move onto a pool thread
+struct PoolSchedule {
+	ThreadPool &tp;
+	bool await_ready() { return false; }
+	void await_suspend(coroutine_handle<> h) { poolPost(tp, h); }
+	void await_resume() {}
+};
+
+// a coroutine that starts straight away and cleans up after itself;
+// completion is reported through a StageLatch
+struct PipelineTask {
+	struct promise_type {
+		PipelineTask get_return_object() { return PipelineTask(); }
+		suspend_never initial_suspend() noexcept { return suspend_never(); }
+		suspend_never final_suspend() noexcept { return suspend_never(); }
+		void return_void() {}
+		void unhandled_exception() { terminate(); }
+	};
+};
+
+struct StageLatch {
+	mutex lock;
+	condition_variable cv;
+	int remaining;
+};
+
+void
+stageDone(StageLatch &l)
+{
+	lock_guard<mutex> lk(l.lock);
+	if (--l.remaining == 0)
+		l.cv.notify_all();
+}
+
+void
+waitStages(StageLatch &l)
+{
+	unique_lock<mutex> lk(l.lock);
+	l.cv.wait(lk, [&l]() { return l.remaining == 0; });
+}
+
+// a bounded queue between coroutines. a consumer waiting on an
+// empty queue is handed the next item directly, and a producer
+// waiting on a full one has its item moved in as soon as a slot
+// frees up; either way the waiter is resumed on the pool. pop
+// yields an empty optional once the queue is closed and drained.
+template <class T>
+struct AsyncQueue {
+	struct PopWaiter;
+	struct PushWaiter;
+
+	ThreadPool &tp;
+	size_t capacity;
+	mutex lock;
+	deque<T> items;
+	deque<PopWaiter *> popWaiters;
+	deque<PushWaiter *> pushWaiters;
+	bool closed;
+
+	AsyncQueue(ThreadPool &pool, size_t cap)
+		: tp(pool), capacity(cap ? cap : 1), closed(false) {}
+
+	struct PopWaiter {
+		AsyncQueue &q;
+		optional<T> value;
+		coroutine_handle<> h;
+		bool await_ready() { return false; }
+		bool await_suspend(coroutine_handle<> handle)
+		{
+			lock_guard<mutex> lk(q.lock);
+			if (!q.items.empty())
+			{
+				value = std::move(q.items.front());
+				q.items.pop_front();
+				if (!q.pushWaiters.empty())
+				{
+					PushWaiter *pw = q.pushWaiters.front();
+					q.pushWaiters.pop_front();
+					q.items.push_back(std::move(*pw->value));
+					poolPost(q.tp, pw->h);
+				}
+				return false;
+			}
+			if (q.closed)
+				return false;
+			h = handle;
+			q.popWaiters.push_back(this);
+			return true;
+		}
+		optional<T> await_resume() { return std::move(value); }
+	};
+
+	struct PushWaiter {
+		AsyncQueue &q;
+		optional<T> value;
+		coroutine_handle<> h;
+		bool await_ready() { return false; }
+		bool await_suspend(coroutine_handle<> handle)
+		{
+			lock_guard<mutex> lk(q.lock);
+			if (!q.popWaiters.empty())
+			{
+				PopWaiter *pw = q.popWaiters.front();
+				q.popWaiters.pop_front();
+				pw->value = std::move(value);
+				poolPost(q.tp, pw->h);
+				return false;
+			}
+			if (q.items.size() < q.capacity)
+			{
+				q.items.push_back(std::move(*value));
+				return false;
+			}
+			h = handle;
+			q.pushWaiters.push_back(this);
+			return true;
+		}
+		void await_resume() {}
+	};
+
+	PopWaiter pop() { return PopWaiter{ *this, nullopt, nullptr }; }
+	PushWaiter push(T item) { return PushWaiter{ *this, std::move(item), nullptr }; }
+
+	// no more pushes; wake everyone waiting for an item
+	void close()
+	{
+		lock_guard<mutex> lk(lock);
+		closed = true;
+		while (!popWaiters.empty())
+		{
+			poolPost(tp, popWaiters.front()->h);
+			popWaiters.pop_front();
+		}
+	}
+};
+
+struct ResyncJob {
+	string path;
+	vector<int> old;	// as read, so the write stage can diff
+	vector<int> w;
+	bool ok;
+};
+
+typedef AsyncQueue<ResyncJob> ResyncQueue;
+
+PipelineTask
+readStage(ThreadPool &tp, const vector<string> &paths, ResyncQueue &out
+		, StageLatch &done)
+{
+	co_await PoolSchedule{ tp };
+	for (unsigned int i = 0; i < paths.size(); i++)
+	{
+		ResyncJob job;
+		job.path = paths[i];
+		job.ok = readCaptureFile(job.path.c_str(), job.w);
+		co_await out.push(std::move(job));
+	}
+	out.close();
+	stageDone(done);
+}
+
+PipelineTask
+reconcileStage(ThreadPool &tp, const SpecIndex &si, ResyncQueue &in
+		, ResyncQueue &out, StageLatch &done)
+{
+	co_await PoolSchedule{ tp };
+	for (;;)
+	{
+		optional<ResyncJob> job = co_await in.pop();
+		if (!job)
+			break;
+		if (job->ok)
+		{
+			job->old = job->w;
+			reconcileIndexed(si, job->w);
+		}
+		co_await out.push(std::move(*job));
+	}
+	out.close();
+	stageDone(done);
+}
+
+PipelineTask
+writeStage(ThreadPool &tp, ResyncQueue &in, atomic<int> &written
+		, StageLatch &done)
+{
+	co_await PoolSchedule{ tp };
+	CaptureIO io;
+	initCaptureIO(io, 1, false);
+	for (;;)
+	{
+		optional<ResyncJob> job = co_await in.pop();
+		if (!job)
+			break;
+		if (!job->ok)
+			continue;
+		vector<string> paths(1, job->path);
+		vector<vector<int> > olds(1), news(1);
+		olds[0].swap(job->old);
+		news[0].swap(job->w);
+		vector<char> ok;
+		writeCaptureChanges(io, paths, olds, news, ok);
+		if (ok[0])
+			written++;
+	}
+	closeCaptureIO(io);
+	stageDone(done);
+}
+
+// reconcile every capture file in paths against si, in place.
+// queueDepth bounds how many files wait between stages. returns
+// how many files were read, reconciled and written back.
+int
+resyncFiles(const SpecIndex &si, const vector<string> &paths
+		, unsigned int queueDepth)
+{
+	ThreadPool tp;
+	startPool(tp, 3);
+	ResyncQueue readQ(tp, queueDepth);
+	ResyncQueue writeQ(tp, queueDepth);
+	atomic<int> written(0);
+	StageLatch done;
+	done.remaining = 3;
+
+	writeStage(tp, writeQ, written, done);
+	reconcileStage(tp, si, readQ, writeQ, done);
+	readStage(tp, paths, readQ, done);
+	waitStages(done);
+	stopPool(tp);
+	return written;
+}
+
+// seqmodify resync [-j <journal>] [-s <stats file>]
+//	[-r <replay file>] [-t <slow call microseconds>] <spec> <file> ...
+int
+resyncUsage()
+{
+	printf("usage: seqmodify resync [-j <journal>] [-s <stats file>]"
+			" [-r <replay file>] [-t <slow call us>] <spec> <file> ...\n");
+	return 1;
+}
+
+int
+runResyncCommand(int argc, char **argv)
+{
+	const char *journal = NULL;
+	const char *statsFile = NULL;
+	const char *replayFile = NULL;
+	uint64_t slowNs = 10000000;
+	bool slowSet = false;
+	while (argc >= 5 && argv[2][0] == '-')
+	{
+		if (strcmp(argv[2], "-j") == 0)
+			journal = argv[3];
+		else if (strcmp(argv[2], "-s") == 0)
+			statsFile = argv[3];
+		else if (strcmp(argv[2], "-r") == 0)
+			replayFile = argv[3];
+		else if (strcmp(argv[2], "-t") == 0)
+		{
+			slowNs = strtoull(argv[3], NULL, 10) * 1000;
+			slowSet = true;
+		}
+		else
+			return resyncUsage();
+		argv += 2;
+		argc -= 2;
+	}
+	// ids are positive, so a spec never starts with '-': anything
+	// left that does is an option short of its arguments
+	if (argc < 3 || argv[2][0] == '-')
+		return resyncUsage();
+	// only the journaled path goes through fixVectors
+	if ((statsFile || replayFile) && !journal)
+	{
+		printf("%s needs -j\n", statsFile ? "-s" : "-r");
+		return resyncUsage();
+	}
+	if (slowSet && !replayFile)
+	{
+		printf("-t needs -r\n");
+		return resyncUsage();
+	}
+	StatsEnabled = (statsFile != NULL);
+	if (replayFile && !startReplayCapture(replayFile, slowNs))
+	{
+		printf("cannot open %s\n", replayFile);
+		return 1;
+	}
+	vector<int> a;
+	loadVec(a, argv[2]);
+	vector<string> paths(argv + 3, argv + argc);
+	int n;
+	if (journal)
+	{
+		int recovered = recoverJournal(journal, false);
+		if (recovered < 0)
+		{
+			printf("cannot recover journal %s\n", journal);
+			return 1;
+		}
+		if (recovered)
+			printf("recovered %d interrupted files\n", recovered);
+		Journal j;
+		if (!openJournal(j, journal))
+		{
+			printf("cannot open journal %s\n", journal);
+			return 1;
+		}
+		CaptureIO io;
+		initCaptureIO(io, 256, true);
+		n = resyncFilesJournaled(io, j, a, paths, 64);
+		closeCaptureIO(io);
+		closeJournal(j);
+	}
+	else
+	{
+		SpecIndex si;
+		buildSpecIndex(si, a);
+		n = resyncFiles(si, paths, 8);
+	}
+	printf("resynced %d of %d files\n", n, (int)paths.size());
+	if (statsFile && !writeStatsFile(statsFile))
+		printf("cannot write %s\n", statsFile);
+	if (replayFile)
+		printf("captured %llu slow calls\n"
+				, (unsigned long long)stopReplayCapture());
+	return (n == (int)paths.size()) ? 0 : 1;
+}
+
+//---------------------------------------------------------------
+// benchmarks
+// seqmodify bench runs these. each case is timed over a number of
+// repetitions and reported as the best pass, in milliseconds.
+//---------------------------------------------------------------
+volatile size_t BenchSink;
+
+// setup runs before every repetition, outside the timed part.
+// returns the best time, in ns.
+template <class S, class F>
+uint64_t
+benchCase(const char *name, int reps, S setup, F f)
+{
+	uint64_t best = UINT64_MAX;
+	for (int r = 0; r < reps; r++)
+	{
+		setup();
+		uint64_t t0 = nowNs();
+		f();
+		uint64_t t = nowNs() - t0;
+		if (t < best)
+			best = t;
+	}
+	printf("  %-40s %10.3f ms\n", name, best / 1e6);
+	return best;
+}
+
+template <class F>
+uint64_t
+benchCase(const char *name, int reps, F f)
+{
+	return benchCase(name, reps, []() {}, f);
+}
+
+// a file vector laid out under spec 1..n*2 (even ids), with
+// roughly 'percent' of its slots captured
+void
+makeBenchFile(vector<int> &w, unsigned int n, unsigned int percent)
+{
+	w.resize(n);
+	unsigned int seed = 2463534242u;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		w[i] = (seed % 100 < percent) ? (int)(i+1) * 2 : 0;
+	}
+}
+
+void
+benchScanning()
+{
+	const unsigned int n = 1 << 22;
+	vector<int> sparse, dense, zeros(n, 0);
+	makeBenchFile(sparse, n, 2);
+	makeBenchFile(dense, n, 98);
+	vector<const ScanOps *> ops = availableScanOps();
+	for (unsigned int k = 0; k < ops.size(); k++)
+	{
+		const ScanOps *op = ops[k];
+		printf("scanning primitives: %s, %u slots\n", op->name, n);
+		benchCase("next non-zero walk, sparse", 5, [&]() {
+			size_t count = 0;
+			for (size_t i = op->nextNonZero(sparse.data(), n, 0); i < n
+					; i = op->nextNonZero(sparse.data(), n, i+1))
+				count++;
+			BenchSink = count;
+		});
+		benchCase("next non-zero walk, dense", 5, [&]() {
+			size_t count = 0;
+			for (size_t i = op->nextNonZero(dense.data(), n, 0); i < n
+					; i = op->nextNonZero(dense.data(), n, i+1))
+				count++;
+			BenchSink = count;
+		});
+		benchCase("count zeros, sparse", 5, [&]() {
+			BenchSink = op->countZeros(sparse.data(), n);
+		});
+		benchCase("count zeros, dense", 5, [&]() {
+			BenchSink = op->countZeros(dense.data(), n);
+		});
+		benchCase("all zeros", 5, [&]() {
+			BenchSink = op->allZeros(zeros.data(), n);
+		});
+		benchCase("find value (absent)", 5, [&]() {
+			BenchSink = op->findValue(dense.data(), n, 0, -1);
+		});
+	}
+
+	printf("sync validation (inline)\n");
+	vector<int> spec(n), inSync = dense;
+	for (unsigned int i = 0; i < n; i++)
+		spec[i] = i + 1;
+	for (unsigned int i = 0; i < n; i++)
+		inSync[i] = (dense[i] != 0) ? spec[i] : 0;
+	benchCase("validateSync, in sync", 5, [&]() {
+		BenchSink = validateSync(spec, inSync);
+	});
+	benchCase("fixVectors, in sync", 5, [&]() {
+		BenchSink = fixVectors(spec, inSync);
+	});
+
+	// a file that needs reconciling, but has nothing to delete
+	printf("deletion check, %u slots\n", n / 64);
+	vector<int> shortSpec(spec.begin(), spec.begin() + n / 64);
+	vector<int> shifted(inSync.begin() + 1, inSync.begin() + n / 64);
+	benchCase("findPossibles", 3, [&]() {
+		vector<int> possibles;
+		findPossibles(possibles, shifted, shortSpec);
+		BenchSink = possibles.size();
+	});
+	benchCase("capturedAllInSpec", 3, [&]() {
+		BenchSink = capturedAllInSpec(shortSpec, shifted);
+	});
+
+	printf("reconcile helpers: %s\n", Scan->name);
+	AnchorIndex ai;
+	benchCase("buildAnchorIndex, sparse", 5, [&]() {
+		buildAnchorIndex(ai, sparse);
+	});
+	benchCase("buildAnchorIndex, dense", 5, [&]() {
+		buildAnchorIndex(ai, dense);
+	});
+}
+
+// a million 32 slot files, as separate vectors and as one batch
+void
+benchBatch()
+{
+	const unsigned int files = 1000000;
+	vector<int> oldSpec, a;
+	for (int i = 1; i <= 32; i++)
+		oldSpec.push_back(i * 3);
+	for (int i = 1; i <= 34; i++)
+	{
+		if (i % 9)
+			a.push_back(i * 3);
+	}
+	SpecIndex si;
+	buildSpecIndex(si, a);
+
+	vector<vector<int> > separate(files);
+	FileVecBatch in, out;
+	initBatch(in);
+	unsigned int seed = 88172645u;
+	for (unsigned int k = 0; k < files; k++)
+	{
+		vector<int> &w = separate[k];
+		w.resize(oldSpec.size());
+		for (unsigned int i = 0; i < w.size(); i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			w[i] = ((seed >> 16) & 1) ? oldSpec[i] : 0;
+		}
+		batchAppend(in, w);
+	}
+
+	printf("batches: %u files of %u slots\n", files, (unsigned int)oldSpec.size());
+	benchCase("reconcileIndexed per vector", 3, [&]() {
+		for (unsigned int k = 0; k < files; k++)
+		{
+			vector<int> w = separate[k];
+			reconcileIndexed(si, w);
+			BenchSink = w.size();
+		}
+	});
+	benchCase("reconcileBatch", 3, [&]() {
+		reconcileBatch(si, in, out);
+		BenchSink = out.ids.size();
+	});
+	benchCase("reconcileFused", 3, [&]() {
+		reconcileFused(si, in, out);
+		BenchSink = out.ids.size();
+	});
+}
+
+// many small files: fixVectors on a SmallFileVec against a vector
+void
+benchSmall()
+{
+	const unsigned int count = 100000;
+	vector<int> a, w;
+	loadVec(a, "1,2,4,5,7,8,10,11,13,14,16,17,19,20,22,23,25,26,28,29");
+	vector<vector<int> > files(count);
+	for (unsigned int k = 0; k < count; k++)
+	{
+		files[k].clear();
+		for (int id = 1; id <= 24; id++)
+			files[k].push_back(((k + id) % 3) ? id : 0);
+	}
+	printf("small files: %u files of 24 slots\n", count);
+	benchCase("fixVectors, vector<int>", 3, [&]() {
+		size_t sum = 0;
+		for (unsigned int k = 0; k < count; k++)
+		{
+			w = files[k];
+			fixVectors(a, w);
+			sum += w.size();
+		}
+		BenchSink = sum;
+	});
+	benchCase("fixVectors, SmallFileVec", 3, [&]() {
+		size_t sum = 0;
+		SmallFileVec sw;
+		for (unsigned int k = 0; k < count; k++)
+		{
+			sw.assign(files[k].data(), files[k].size());
+			fixVectors(a, sw);
+			sum += sw.size();
+		}
+		BenchSink = sum;
+	});
+}
+
+// a big file against a spec that drops and adds an id every 2000,
+// cut into more and more segments. fixVectors costs more than
+// linear in the file size, so cutting alone speeds it up; each cut
+// is timed on one thread too, and the speedup reported is what the
+// threads add on top.
+void
+benchParallel()
+{
+	const unsigned int n = 1 << 15;
+	vector<int> file, a;
+	makeBenchFile(file, n, 50);
+	for (unsigned int i = 1; i <= n; i++)
+	{
+		if (i % 2000 != 7)
+			a.push_back(i * 2);
+		if (i % 2000 == 1000)
+			a.push_back(i * 2 + 1);
+	}
+	printf("parallel reconcile: %u slots, %u hardware threads\n", n
+			, thread::hardware_concurrency());
+	vector<int> w;
+	benchCase("fixVectors, uncut", 3, [&]() {
+		w = file;
+	}, [&]() {
+		fixVectors(a, w);
+	});
+	for (unsigned int threads = 2; threads <= 16; threads *= 2)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "%u segments, one thread", threads);
+		uint64_t serial = benchCase(name, 3, [&]() {
+			w = file;
+		}, [&]() {
+			fixVectorsParallel(a, w, threads, true);
+		});
+		snprintf(name, sizeof(name), "%u segments, %u threads", threads
+				, threads);
+		uint64_t t = benchCase(name, 3, [&]() {
+			w = file;
+		}, [&]() {
+			fixVectorsParallel(a, w, threads);
+		});
+		printf("    speedup from threads %.2fx\n", (double)serial / t);
+	}
+}
+
+void
+runBench()
+{
+	bool saved = DebugLog;
+	DebugLog = false;
+	benchScanning();
+	benchBatch();
+	benchSmall();
+	benchParallel();
+	DebugLog = saved;
+}
+
+struct ReplayCase {
+	uint32_t flags;
+	uint64_t elapsedNs;
+	uint64_t resultHash;
+	vector<int> spec;
+	vector<int> w;
+};
+
+// read back what startReplayCapture wrote. a record cut short
+// ends the file.
+bool
+loadReplayFile(const char *path, vector<ReplayCase> &cases)
+{
+	cases.clear();
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	ReplayHeader h;
+	while (readFull(fd, &h, sizeof(h)) && h.magic == ReplayMagic
+			&& ((uint64_t)h.specLen + h.fileLen) * sizeof(int)
+				<= (uint64_t)st.st_size)
+	{
+		ReplayCase c;
+		c.flags = h.flags;
+		c.elapsedNs = h.elapsedNs;
+		c.resultHash = h.resultHash;
+		c.spec.resize(h.specLen);
+		c.w.resize(h.fileLen);
+		if (!readFull(fd, c.spec.data(), h.specLen * sizeof(int))
+				|| !readFull(fd, c.w.data(), h.fileLen * sizeof(int)))
+			break;
+		cases.push_back(std::move(c));
+	}
+	close(fd);
+	return true;
+}
+
+// what a captured call was handed besides its file vector. built
+// once per case, so the replay times only fixVectors itself.
+struct ReplayInputs {
+	vector<int> a;
+	vector<int> script;
+};
+
+void
+prepareReplay(const ReplayCase &c, ReplayInputs &in)
+{
+	in.a = c.spec;
+	in.script.clear();
+}
+
+// w must start out as a copy of c.w
+void
+runReplay(const ReplayCase &c, ReplayInputs &in, vector<int> &w)
+{
+	fixVectors(in.a, w, (c.flags & REPLAY_SCRIPT) ? &in.script : NULL);
+}
+
+// rerun one captured call the way it was made. returns false if it
+// no longer gives the same answer.
+bool
+replayCase(const ReplayCase &c)
+{
+	ReplayInputs in;
+	prepareReplay(c, in);
+	vector<int> w = c.w;
+	runReplay(c, in, w);
+	return hashSpec(w) == c.resultHash;
+}
+
+// seqmodify replay <replay file>
+int
+runReplayCommand(const char *path)
+{
+	vector<ReplayCase> cases;
+	if (!loadReplayFile(path, cases))
+	{
+		printf("cannot read %s\n", path);
+		return 1;
+	}
+	bool saved = DebugLog;
+	DebugLog = false;
+	int changed = 0;
+	printf("replaying %u slow calls from %s\n", (unsigned)cases.size(), path);
+	for (unsigned int k = 0; k < cases.size(); k++)
+	{
+		const ReplayCase &c = cases[k];
+		char name[96];
+		snprintf(name, sizeof(name), "#%u: %u/%u slots, was %.3f ms", k
+				, (unsigned)c.spec.size(), (unsigned)c.w.size()
+				, c.elapsedNs / 1e6);
+		ReplayInputs in;
+		vector<int> w;
+		prepareReplay(c, in);
+		benchCase(name, 5, [&]() {
+			w = c.w;
+			in.script.clear();
+		}, [&]() {
+			runReplay(c, in, w);
+		});
+		if (hashSpec(w) != c.resultHash)
+		{
+			printf("    result differs from the captured call\n");
+			changed++;
+		}
+	}
+	DebugLog = saved;
+	return changed ? 1 : 0;
+}
+
+//---------------------------------------------------------------
+// main test program
+//---------------------------------------------------------------
+// capture files in every shape fixVectors has to deal with, and
+// what each becomes reconciled against TestSpec. the file tests
+// share these.
+const char *TestSpec = "5,10,15,20";
+
+struct TestFile {
+	const char *w;
+	const char *fixed;	// reconciled against TestSpec
+};
+
+const TestFile TestFiles[] = {
+	{ "0,0", "0,0,0,0" },
+	{ "5,10,15", "5,10,15,0" },
+	{ "5,6,10", "5,10,0,0" },
+	{ "0,0,0,20,0", "0,0,0,20" },
+	{ "5,0,0,0,40", "5,0,0,0" },
+	{ "", "0,0,0,0" },
+	{ "10,15", "0,10,15,0" },
+	{ "5,0,0,40", "5,0,0,0" },
+	{ "0,10,15,0,0", "0,10,15,0" }
+};
+const unsigned int TestFileCount = sizeof(TestFiles) / sizeof(TestFiles[0]);
+
+// turns debug logging off on this thread for as long as it lives
+struct QuietLog {
+	bool saved;
+	QuietLog() : saved(DebugLog) { DebugLog = false; }
+	~QuietLog() { DebugLog = saved; }
+};
+
+// run the server on a private socket and pipeline a few of the
+// cases above through the bundled client
+void
+testReconcileServer()
+{
+	char path[64];
+	sprintf(path, "/tmp/seqmodify-test-%d.sock", (int)getpid());
+	int listenFd = openServerSocket(path);
+	if (listenFd < 0)
+	{
+		printf("ERROR: cannot open %s\n", path);
+		FailCount++;
+		return;
+	}
+	unsigned int peak = 0;
+	thread server(runReconcileServer, listenFd, &peak);
+
+	const char *files[] = { "0,0", "5,6,10", "0,0,0,20,0", "5,0,0,0,40" };
+	const char *expect[] = { "0,0,0,0", "5,10,0,0", "0,0,0,20", "5,0,0,0" };
+	const int count = sizeof(files) / sizeof(files[0]);
+
+	ReconcileClient c;
+	ReconcileClient idle;
+	idle.fd = -1;
+	vector<int> vec;
+	if (!clientConnect(c, path))
+		FailCount++;
+	else
+	{
+		loadVec(vec, "5,10,15,20");
+		clientSend(c, OP_LOAD_SPEC, 7, vec);
+		for (int i = 0; i < count; i++)
+		{
+			loadVec(vec, files[i]);
+			clientSend(c, OP_RECONCILE, 7, vec);
+		}
+		loadVec(vec, "1");
+		clientSend(c, OP_RECONCILE, 8, vec);
+		clientFlush(c);
+
+		uint32_t status;
+		if (!clientReadResponse(c, status, vec) || status != ST_OK)
+			FailCount++;
+		for (int i = 0; i < count; i++)
+		{
+			vector<int> want;
+			loadVec(want, expect[i]);
+			if (!clientReadResponse(c, status, vec) || status != ST_OK
+					|| vec != want)
+			{
+				printf("ERROR: server reconcile of %s\n", files[i]);
+				FailCount++;
+			}
+		}
+		if (!clientReadResponse(c, status, vec) || status != ST_UNKNOWN_SPEC)
+			FailCount++;
+
+		// fill the spec table: one id past the cap is refused until
+		// another is dropped, and replacing a resident id still works
+		loadVec(vec, "5,10");
+		for (uint32_t id = 1; id < MaxServerSpecs; id++)
+			clientSend(c, OP_LOAD_SPEC, 100 + id, vec);
+		clientSend(c, OP_LOAD_SPEC, 99999, vec);
+		clientSend(c, OP_LOAD_SPEC, 7, vec);
+		clientSend(c, OP_DROP_SPEC, 101, vec);
+		clientSend(c, OP_LOAD_SPEC, 99999, vec);
+		clientFlush(c);
+		int bad = 0;
+		for (uint32_t id = 1; id < MaxServerSpecs; id++)
+			if (!clientReadResponse(c, status, vec) || status != ST_OK)
+				bad++;
+		uint32_t want[] = { ST_TOO_MANY_SPECS, ST_OK, ST_OK, ST_OK };
+		for (int i = 0; i < 4; i++)
+			if (!clientReadResponse(c, status, vec) || status != want[i])
+				bad++;
+		if (bad)
+		{
+			printf("ERROR: server spec cap, %d bad answers\n", bad);
+			FailCount++;
+		}
+
+		// short-lived connections don't pile up threads: each one is
+		// joined once it has closed
+		const int shortLived = 200;
+		for (int i = 0; i < shortLived; i++)
+		{
+			ReconcileClient sc;
+			vec.clear();
+			if (!clientConnect(sc, path))
+			{
+				FailCount++;
+				break;
+			}
+			clientSend(sc, OP_DROP_SPEC, 1, vec);
+			clientFlush(sc);
+			clientReadResponse(sc, status, vec);
+			clientClose(sc);
+		}
+
+		// an idle connection mustn't hold up the shutdown. one round
+		// trip makes sure the server has accepted it
+		vec.clear();
+		if (!clientConnect(idle, path))
+			FailCount++;
+		else
+		{
+			clientSend(idle, OP_DROP_SPEC, 1, vec);
+			clientFlush(idle);
+			if (!clientReadResponse(idle, status, vec)
+					|| status != ST_UNKNOWN_SPEC)
+				FailCount++;
+		}
+		clientSend(c, OP_SHUTDOWN, 0, vec);
+		clientFlush(c);
+		clientReadResponse(c, status, vec);
+		clientClose(c);
+	}
+	server.join();
+	clientClose(idle);
+	if (peak > 16)
+	{
+		printf("ERROR: server held %u connection threads\n", peak);
+		FailCount++;
+	}
+	unlink(path);
+	printf("testReconcileServer done\n");
+}
+
+void
+testSpecIndexCache()
+{
+	SpecIndexCache c;
+	initSpecIndexCache(c, 2);
+	vector<int> a1, a2, a3, w, want;
+	loadVec(a1, "5,10,15,20");
+	loadVec(a2, "1,5,10,15,17,18");
+	loadVec(a3, "3,13,23");
+
+	loadVec(w, "0,6,0,17,0");
+	reconcileCached(c, a2, w);
+	loadVec(want, "0,0,0,0,17,0");
+	if (w != want)
+		FailCount++;
+	getSpecIndex(c, a2);		// hit
+	getSpecIndex(c, a1);		// miss
+	getSpecIndex(c, a3);		// miss, evicts a2
+	loadVec(w, "5,0,0,40");
+	reconcileCached(c, a1, w);	// hit
+	loadVec(want, "5,0,0,0");
+	if (w != want)
+		FailCount++;
+	getSpecIndex(c, a2);		// miss again
+
+	uint64_t hits, misses;
+	specCacheStats(c, hits, misses);
+	if (hits != 2 || misses != 4 || c.lru.size() != 2)
+	{
+		printf("ERROR: spec cache hits=%d misses=%d\n", (int)hits, (int)misses);
+		FailCount++;
+	}
+	printf("testSpecIndexCache done\n");
+}
+
+// std::array's == isn't constexpr before c++20
+template <size_t N>
+constexpr bool
+sameArray(const array<int, N> &x, const array<int, N> &y)
+{
+	for (size_t i = 0; i < N; i++)
+	{
+		if (x[i] != y[i])
+			return false;
+	}
+	return true;
+}
+
+// the example from the top of the file, worked out by the compiler
+constexpr array<int, 4> ExampleOldSpec = { 1, 4, 8, 9 };
+constexpr array<int, 4> ExampleNewSpec = { 1, 8, 9, 10 };
+constexpr array<int, 4> ExampleFile = { 0, 0, 8, 0 };
+static_assert(sameArray(fixArray(ExampleNewSpec, ExampleFile)
+		, array<int, 4>{ 0, 8, 0, 0 }), "fixArray");
+
+// TestFiles, against TestSpec
+constexpr array<int, 4> FixtureSpec = { 5, 10, 15, 20 };
+static_assert(sameArray(fixArray(FixtureSpec, array<int, 2>{ 0, 0 })
+		, array<int, 4>{ 0, 0, 0, 0 }), "fixArray 0,0");
+static_assert(sameArray(fixArray(FixtureSpec, array<int, 3>{ 5, 10, 15 })
+		, array<int, 4>{ 5, 10, 15, 0 }), "fixArray 5,10,15");
+static_assert(sameArray(fixArray(FixtureSpec, array<int, 3>{ 5, 6, 10 })
+		, array<int, 4>{ 5, 10, 0, 0 }), "fixArray 5,6,10");
+static_assert(sameArray(fixArray(FixtureSpec
+		, array<int, 5>{ 0, 0, 0, 20, 0 })
+		, array<int, 4>{ 0, 0, 0, 20 }), "fixArray 0,0,0,20,0");
+static_assert(sameArray(fixArray(FixtureSpec
+		, array<int, 5>{ 5, 0, 0, 0, 40 })
+		, array<int, 4>{ 5, 0, 0, 0 }), "fixArray 5,0,0,0,40");
+static_assert(sameArray(fixArray(FixtureSpec, array<int, 0>{})
+		, array<int, 4>{ 0, 0, 0, 0 }), "fixArray empty");
+static_assert(sameArray(fixArray(FixtureSpec, array<int, 2>{ 10, 15 })
+		, array<int, 4>{ 0, 10, 15, 0 }), "fixArray 10,15");
+static_assert(sameArray(fixArray(FixtureSpec, array<int, 4>{ 5, 0, 0, 40 })
+		, array<int, 4>{ 5, 0, 0, 0 }), "fixArray 5,0,0,40");
+static_assert(sameArray(fixArray(FixtureSpec
+		, array<int, 5>{ 0, 10, 15, 0, 0 })
+		, array<int, 4>{ 0, 10, 15, 0 }), "fixArray 0,10,15,0,0");
+constexpr SpecTransitionTable<4, 4> ExampleTransition
+		= makeSpecTransition(ExampleOldSpec, ExampleNewSpec);
+static_assert(sameArray(ExampleTransition.from
+		, array<int, 4>{ 0, 2, 3, -1 }), "makeSpecTransition");
+
+void
+testSpecTransitionTable()
+{
+	vector<int> w, want;
+	loadVec(w, "1,0,8,9");
+	loadVec(want, "1,8,9,0");
+	if (!resyncFromTable(ExampleTransition, w) || w != want)
+		FailCount++;
+	// not laid out under the old spec, must be refused
+	loadVec(w, "1,0,8,10");
+	if (resyncFromTable(ExampleTransition, w))
+		FailCount++;
+
+	// fixVectors lands where the static_asserts above put fixArray:
+	// the same files, and the results TestFiles expects
+	vector<int> a(FixtureSpec.begin(), FixtureSpec.end()), spec;
+	loadVec(spec, TestSpec);
+	if (a != spec)
+		FailCount++;
+	QuietLog quiet;
+	for (unsigned int k = 0; k < TestFileCount; k++)
+	{
+		loadVec(w, TestFiles[k].w);
+		loadVec(want, TestFiles[k].fixed);
+		fixVectors(a, w);
+		if (w != want)
+		{
+			printf("ERROR: fixVectors and fixArray differ on %s\n"
+					, TestFiles[k].w);
+			FailCount++;
+		}
+	}
+	printf("testSpecTransitionTable done\n");
+}
+
+void
+testTransitionPlan()
+{
+	TransitionPlan tp;
+	vector<int> oldSpec, newSpec, w, want;
+	loadVec(oldSpec, "5,10,15,20");
+	loadVec(newSpec, "1,5,15,20,25");
+	buildTransitionPlan(tp, oldSpec, newSpec);
+
+	loadVec(w, "5,10,0,20");
+	loadVec(want, "0,5,0,20,0");
+	if (!applyTransitionPlan(tp, w) || w != want)
+		FailCount++;
+	// wrong layout for the old spec, so this takes the fallback
+	loadVec(w, "5,6,15");
+	loadVec(want, "0,5,15,0,0");
+	if (applyTransitionPlan(tp, w) || w != want)
+		FailCount++;
+	printf("testTransitionPlan done\n");
+}
+
+// a big old spec with half its records captured, then a new spec
+// that drops and adds ids throughout
+void
+testFixVectorsParallel()
+{
+	vector<int> oldSpec, a, w;
+	unsigned int seed = 12345;
+	int id = 0;
+	for (int i = 0; i < 6000; i++)
+	{
+		id += 1 + (seed >> 16) % 3;
+		seed = seed * 1103515245 + 12345;
+		oldSpec.push_back(id);
+		w.push_back(((seed >> 16) & 1) ? id : 0);
+		seed = seed * 1103515245 + 12345;
+	}
+	for (unsigned int i = 0; i < oldSpec.size(); i++)
+	{
+		if (i % 97 != 5)
+			a.push_back(oldSpec[i]);
+		if (i % 89 == 3)
+			a.push_back(oldSpec[i] + 1000000);
+	}
+	sort(a.begin(), a.end());
+
+	SpecIndex si;
+	vector<int> want = w;
+	buildSpecIndex(si, a);
+	reconcileIndexed(si, want);
+
+	QuietLog quiet;
+	StatsSnapshot before, after;
+	snapshotStats(before);
+	StatsEnabled = true;
+	bool ok = fixVectorsParallel(a, w, 4);
+	StatsEnabled = false;
+	snapshotStats(after);
+	if (!ok || w != want)
+	{
+		printf("ERROR: fixVectorsParallel\n");
+		FailCount++;
+	}
+	// one call in the stats, however many segments it was cut into
+	if (after.hist[STAT_SLOTS].count - before.hist[STAT_SLOTS].count != 1
+			|| after.outcomes[OUTCOME_RECONCILED]
+				- before.outcomes[OUTCOME_RECONCILED] != 1)
+	{
+		printf("ERROR: fixVectorsParallel recorded %llu calls\n"
+				, (unsigned long long)(after.hist[STAT_SLOTS].count
+					- before.hist[STAT_SLOTS].count));
+		FailCount++;
+	}
+	printf("testFixVectorsParallel done\n");
+}
+
+// how many of to's chunks are shared with from
+unsigned int
+sharedChunks(const FileSnapshot &from, const FileSnapshot &to)
+{
+	set<const vector<int> *> old;
+	for (unsigned int c = 0; c < from.chunks.size(); c++)
+		old.insert(from.chunks[c].get());
+	unsigned int shared = 0;
+	for (unsigned int c = 0; c < to.chunks.size(); c++)
+		shared += old.count(to.chunks[c].get());
+	return shared;
+}
+
+void
+testFileSnapshot()
+{
+	vector<int> oldSpec, w, flat;
+	for (int i = 1; i <= 1000; i++)
+	{
+		oldSpec.push_back(i * 2);
+		w.push_back(i % 3 ? i * 2 : 0);
+	}
+	FileSnapshot before;
+	makeSnapshot(before, w);
+
+	// an id appended at the end, an id inserted near the front and
+	// an id dropped near the front: each only rebuilds the chunk it
+	// lands in, the rest are shared even where they have moved
+	for (int edit = 0; edit < 3; edit++)
+	{
+		vector<int> a = oldSpec, expect = w;
+		if (edit == 0)
+			a.push_back(5000);
+		else if (edit == 1)
+			a.insert(a.begin() + 1, 3);
+		else
+			a.erase(a.begin() + 1);
+		SpecIndex si;
+		buildSpecIndex(si, a);
+		FileSnapshot after;
+		if (!reconcileSnapshot(si, before, after))
+			FailCount++;
+		if (sharedChunks(before, after) != before.chunks.size() - 1)
+		{
+			printf("ERROR: testFileSnapshot edit %d shares %u of %u chunks\n"
+					, edit, sharedChunks(before, after)
+					, (unsigned int)before.chunks.size());
+			FailCount++;
+		}
+		reconcileIndexed(si, expect);
+		flattenSnapshot(after, flat);
+		if (flat != expect || after.size != expect.size())
+			FailCount++;
+		for (unsigned int i = 0; i < expect.size(); i += 97)
+		{
+			if (snapshotAt(after, i) != expect[i])
+				FailCount++;
+		}
+	}
+
+	// the old version is still what it was
+	flattenSnapshot(before, flat);
+	if (flat != w)
+		FailCount++;
+
+	// scattered edits on top of each other, checked against the
+	// flat reconcile each time
+	srand(32);
+	FileSnapshot cur = before;
+	vector<int> spec = oldSpec, expect = w;
+	int nextId = 3001;
+	for (int round = 0; round < 50; round++)
+	{
+		for (int k = rand() % 5; k >= 0; k--)
+		{
+			unsigned int at = rand() % (spec.size() + 1);
+			if (rand() % 2 && at < spec.size())
+				spec.erase(spec.begin() + at);
+			else
+				spec.insert(spec.begin() + at, nextId++);
+		}
+		SpecIndex si;
+		buildSpecIndex(si, spec);
+		FileSnapshot next;
+		reconcileSnapshot(si, cur, next);
+		reconcileIndexed(si, expect);
+		flattenSnapshot(next, flat);
+		if (flat != expect)
+		{
+			printf("ERROR: testFileSnapshot round %d differs\n", round);
+			FailCount++;
+			break;
+		}
+		for (unsigned int c = 0; c < next.chunks.size(); c++)
+		{
+			if (next.chunks[c]->size() > FileChunkLen * 2)
+				FailCount++;
+		}
+		cur = next;
+	}
+	printf("testFileSnapshot done\n");
+}
+
+// readers spin on the published vector while the resync thread
+// flips it between two specs. every read has to see one complete
+// version or the other.
+void
+testFileVecPublisher()
+{
+	vector<int> a1, a2, w;
+	loadVec(a1, "5,10,15,20");
+	loadVec(a2, "1,5,10,15,17,18");
+	loadVec(w, "5,0,15,0");
+
+	FileVecPublisher p;
+	initPublisher(p, w);
+	atomic<bool> done(false);
+	atomic<int> bad(0);
+	vector<thread> readers;
+	for (int r = 0; r < 3; r++)
+	{
+		readers.push_back(thread([&]() {
+			int slot = registerReader(p);
+			while (!done)
+			{
+				const vector<int> *v = readLock(p, slot);
+				if (!fldNumListsMatch(a1, *v) && !fldNumListsMatch(a2, *v))
+					bad++;
+				readUnlock(p, slot);
+			}
+			releaseReader(p, slot);
+		}));
+	}
+	QuietLog quiet;
+	for (int i = 0; i < 200; i++)
+	{
+		if (!reconcileAndPublish(p, (i % 2) ? a1 : a2))
+			bad++;
+	}
+	done = true;
+	for (unsigned int r = 0; r < readers.size(); r++)
+		readers[r].join();
+
+	vector<int> want;
+	loadVec(want, "5,0,15,0");
+	if (bad || *p.current.load() != want)
+		FailCount++;
+	// no readers left, so one more publish frees everything retired
+	publish(p, new vector<int>(want));
+	if (p.retired.size())
+		FailCount++;
+	destroyPublisher(p);
+	printf("testFileVecPublisher done\n");
+}
+
+// take every slot in the first block, so the next reader gets one
+// in a new block, and check that it reads without waiting on a
+// resync and keeps what it reads alive like any other reader
+void
+testPublisherOverflow()
+{
+	vector<int> a1, a2, w;
+	loadVec(a1, "5,10,15,20");
+	loadVec(a2, "1,5,10,15,17,18");
+	loadVec(w, "5,0,15,0");
+
+	FileVecPublisher p;
+	initPublisher(p, w);
+	vector<int> slots;
+	for (unsigned int i = 0; i < MaxReaders; i++)
+		slots.push_back(registerReader(p));
+	int extra = registerReader(p);
+	if (extra != (int)MaxReaders || p.readers.next.load() == NULL)
+	{
+		printf("ERROR: no second reader block\n");
+		FailCount++;
+	}
+
+	// a resync in progress holds writerLock; the read mustn't wait
+	p.writerLock.lock();
+	const vector<int> *held = readLock(p, extra);
+	p.writerLock.unlock();
+
+	// the version it holds survives publishes until it lets go
+	vector<int> seen = *held;
+	for (int i = 0; i < 3; i++)
+		publish(p, new vector<int>(seen));
+	if (*held != seen || p.retired.empty())
+		FailCount++;
+	readUnlock(p, extra);
+	publish(p, new vector<int>(seen));
+	if (p.retired.size())
+		FailCount++;
+
+	atomic<bool> done(false);
+	atomic<int> published(0);
+	int bad = 0;
+	thread writer([&]() {
+		DebugLog = false;
+		for (int i = 0; !done; i++, published++)
+			reconcileAndPublish(p, (i % 2) ? a1 : a2);
+	});
+	for (int i = 0; i < 2000 || published < 200; i++)
+	{
+		const vector<int> *v = readLock(p, extra);
+		if (!fldNumListsMatch(a1, *v) && !fldNumListsMatch(a2, *v))
+			bad++;
+		readUnlock(p, extra);
+		this_thread::yield();
+	}
+	done = true;
+	writer.join();
+	releaseReader(p, extra);
+	if (bad)
+	{
+		printf("ERROR: %d torn reads from the second block\n", bad);
+		FailCount++;
+	}
+
+	// freed slots are handed out again, in either block
+	releaseReader(p, slots[10]);
+	if (registerReader(p) != slots[10] || registerReader(p) != extra)
+		FailCount++;
+	for (unsigned int i = 0; i < slots.size(); i++)
+		releaseReader(p, slots[i]);
+	releaseReader(p, extra);
+	destroyPublisher(p);
+	printf("testPublisherOverflow done\n");
+}
+
+// one thread fills every slot of a 2000 id file while the main
+// thread keeps resyncing it between two specs that share those ids
+void
+testCaptureDuringResync()
+{
+	vector<int> a1, a2, w;
+	for (int i = 1; i <= 2000; i++)
+	{
+		a1.push_back(i * 10);
+		a2.push_back(i * 10);
+		if (i % 7 == 0)
+			a2.push_back(i * 10 + 5);
+	}
+	shared_ptr<SpecIndex> si1(new SpecIndex);
+	shared_ptr<SpecIndex> si2(new SpecIndex);
+	buildSpecIndex(*si1, a1);
+	buildSpecIndex(*si2, a2);
+
+	CaptureFile cf;
+	w.assign(a1.size(), 0);
+	initCaptureFile(cf, si1, w, 4096);
+	atomic<bool> filled(false);
+	thread capture([&]() {
+		for (int i = 1; i <= 2000; i++)
+		{
+			while (!captureFill(cf, i * 10))
+				this_thread::yield();
+		}
+		filled = true;
+	});
+	int resyncs = 0;
+	while (!filled || resyncs < 2)
+	{
+		resyncCaptureFile(cf, (resyncs % 2) ? si1 : si2);
+		resyncs++;
+	}
+	capture.join();
+	resyncCaptureFile(cf, si2);
+
+	captureFileContents(cf, w);
+	vector<int> want = a2;
+	for (unsigned int i = 0; i < want.size(); i++)
+	{
+		if (want[i] % 10)
+			want[i] = 0;
+	}
+	if (w != want)
+	{
+		printf("ERROR: fills lost during resync\n");
+		FailCount++;
+	}
+	destroyCaptureFile(cf);
+
+	// a fill that arrives mid-resync is judged against the spec the
+	// resync is moving to. pose as a resync that is in progress
+	w.assign(a2.size(), 0);
+	initCaptureFile(cf, si2, w, 16);
+	cf.incoming = si1.get();
+	cf.resyncing = true;
+	if (captureFill(cf, 75) || !captureFill(cf, 70) || cf.log.tail != 1)
+	{
+		printf("ERROR: captureFill during resync accepted a dropped id\n");
+		FailCount++;
+	}
+	cf.resyncing = false;
+	destroyCaptureFile(cf);
+
+	// fillers that never stop mustn't starve the resync
+	w.assign(a1.size(), 0);
+	initCaptureFile(cf, si1, w, 1 << 16);
+	atomic<bool> stop(false);
+	vector<thread> fillers;
+	for (int t = 0; t < 4; t++)
+	{
+		fillers.push_back(thread([&, t]() {
+			for (int i = 0; !stop; i++)
+				captureFill(cf, ((i * 4 + t) % 2000 + 1) * 10);
+		}));
+	}
+	for (int r = 0; r < 50; r++)
+		resyncCaptureFile(cf, (r % 2) ? si1 : si2);
+	stop = true;
+	for (unsigned int t = 0; t < fillers.size(); t++)
+		fillers[t].join();
+	destroyCaptureFile(cf);
+	printf("testCaptureDuringResync done\n");
+}
+
+// every implementation must agree with the scalar one, at every
+// alignment and with the hit in every lane
+void
+testScanPrimitives()
+{
+	vector<const ScanOps *> ops = availableScanOps();
+	vector<int> v;
+	for (unsigned int n = 0; n < 80; n++)
+	{
+		for (unsigned int hit = 0; hit <= n; hit++)
+		{
+			v.assign(n, 0);
+			if (hit < n)
+				v[hit] = 7;
+			for (unsigned int k = 0; k < ops.size(); k++)
+			{
+				for (unsigned int from = 0; from <= n; from += 3)
+				{
+					if (ops[k]->nextNonZero(v.data(), n, from)
+							!= scalarNextNonZero(v.data(), n, from)
+							|| ops[k]->findValue(v.data(), n, from, 7)
+							!= scalarFindValue(v.data(), n, from, 7))
+					{
+						printf("ERROR: %s scan n=%u hit=%u\n", ops[k]->name, n, hit);
+						FailCount++;
+					}
+				}
+				if (ops[k]->countZeros(v.data(), n) != scalarCountZeros(v.data(), n)
+						|| ops[k]->allZeros(v.data(), n) != (hit == n))
+				{
+					printf("ERROR: %s count n=%u hit=%u\n", ops[k]->name, n, hit);
+					FailCount++;
+				}
+			}
+		}
+	}
+	printf("testScanPrimitives done (%s)\n", Scan->name);
+}
+
+void
+testReconcileBatch()
+{
+	const char *files[] = { "0,0", "5,10,15", "5,6,10", "0,0,0,20,0"
+		, "5,0,0,0,40", "", "15,10", "5,10,15,90000000", "5,2147483647"
+		, "0,0,0,2147483647" };
+	const int count = sizeof(files) / sizeof(files[0]);
+	// small ids take the lookup table, large ones the merge,
+	// and INT_MAX, the fused kernel's end marker, is a legal id too
+	const char *specs[] = { "5,10,15,20", "5,10,15,90000000"
+			, "5,10,15,2147483647" };
+	for (int s = 0; s < 3; s++)
+	{
+		vector<int> a, w;
+		loadVec(a, specs[s]);
+		SpecIndex si;
+		buildSpecIndex(si, a);
+
+		FileVecBatch in, out;
+		initBatch(in);
+		for (int k = 0; k < count; k++)
+		{
+			loadVec(w, files[k]);
+			batchAppend(in, w);
+		}
+		FileVecBatch fused;
+		reconcileBatch(si, in, out);
+		reconcileFused(si, in, fused);
+		if (batchCount(out) != (unsigned int)count || fused.ids != out.ids)
+			FailCount++;
+		for (int k = 0; k < count; k++)
+		{
+			vector<int> got;
+			loadVec(w, files[k]);
+			reconcileIndexed(si, w);
+			batchFile(out, k, got);
+			if (got != w)
+			{
+				printf("ERROR: batch reconcile of %s\n", files[k]);
+				FailCount++;
+			}
+		}
+	}
+	printf("testReconcileBatch done\n");
+}
+
+// make a private directory of capture files for the file tests
+bool
+makeTestDir(string &dir)
+{
+	char tmpl[] = "/tmp/seqmodify-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return false;
+	dir = tmpl;
+	return true;
+}
+
+void
+removeTestDir(const string &dir, const vector<string> &paths)
+{
+	for (unsigned int i = 0; i < paths.size(); i++)
+		unlink(paths[i].c_str());
+	rmdir(dir.c_str());
+}
+
+// write the count files as dir/f0, dir/f1, ... and add their paths
+// to paths. false if any couldn't be written.
+bool
+writeTestFiles(const string &dir, const TestFile *files, unsigned int count
+		, vector<string> &paths)
+{
+	bool ok = true;
+	for (unsigned int k = 0; k < count; k++)
+	{
+		char name[32];
+		sprintf(name, "/f%u", k);
+		paths.push_back(dir + name);
+		vector<int> w;
+		loadVec(w, files[k].w);
+		ok = writeCaptureFile(paths.back().c_str(), w) && ok;
+	}
+	return ok;
+}
+
+// more files than the queues hold, so the stages have to wait on
+// each other
+void
+testResyncPipeline()
+{
+	string dir;
+	if (!makeTestDir(dir))
+	{
+		FailCount++;
+		return;
+	}
+	vector<int> a;
+	loadVec(a, TestSpec);
+	SpecIndex si;
+	buildSpecIndex(si, a);
+
+	vector<string> paths;
+	if (!writeTestFiles(dir, TestFiles, TestFileCount, paths))
+		FailCount++;
+	paths.push_back(dir + "/missing");
+	if (resyncFiles(si, paths, 2) != (int)TestFileCount)
+		FailCount++;
+	paths.pop_back();
+	for (unsigned int k = 0; k < TestFileCount; k++)
+	{
+		vector<int> got, want;
+		loadVec(want, TestFiles[k].fixed);
+		if (!readCaptureFile(paths[k].c_str(), got) || got != want)
+		{
+			printf("ERROR: pipeline resync of %s\n", TestFiles[k].w);
+			FailCount++;
+		}
+	}
+	removeTestDir(dir, paths);
+	printf("testResyncPipeline done\n");
+}
+
+// run the same files through the ring (if this kernel has one)
+// and through the plain syscall fallback
+void
+testBatchedCaptureIO()
+{
+	vector<int> a;
+	loadVec(a, TestSpec);
+	SpecIndex si;
+	buildSpecIndex(si, a);
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		string dir;
+		if (!makeTestDir(dir))
+		{
+			FailCount++;
+			return;
+		}
+		vector<string> paths;
+		if (!writeTestFiles(dir, TestFiles, TestFileCount, paths))
+			FailCount++;
+		paths.push_back(dir + "/missing");
+
+		CaptureIO io;
+		initCaptureIO(io, 8, mode == 0);
+		bool uring = io.uring;
+		int n = resyncFilesBatched(io, si, paths, 5);
+		closeCaptureIO(io);
+		if (n != (int)TestFileCount)
+			FailCount++;
+		// two batches, each: open+stat, read, close, open, write,
+		// close, and none of those fit in more than two enters
+		if (uring && io.enterCalls > 2 * 6 * 2)
+		{
+			printf("ERROR: %u io_uring_enter calls\n", io.enterCalls);
+			FailCount++;
+		}
+
+		paths.pop_back();
+		for (unsigned int k = 0; k < TestFileCount; k++)
+		{
+			vector<int> got, want;
+			loadVec(want, TestFiles[k].fixed);
+			if (!readCaptureFile(paths[k].c_str(), got) || got != want)
+			{
+				printf("ERROR: batched resync of %s (%s)\n", TestFiles[k].w
+						, uring ? "io_uring" : "syscalls");
+				FailCount++;
+			}
+		}
+		removeTestDir(dir, paths);
+		if (mode == 0)
+			printf("testBatchedCaptureIO: %s\n", uring ? "io_uring" : "no io_uring");
+	}
+
+	// a ring whose io_uring_enter fails must not leave work behind
+	// in it: the batch finishes with plain syscalls, and so does the
+	// next one. point ringFd at something that isn't a ring.
+	CaptureIO io;
+	initCaptureIO(io, 8, true);
+	if (io.uring)
+	{
+		string dir;
+		if (!makeTestDir(dir))
+		{
+			FailCount++;
+			return;
+		}
+		vector<string> paths;
+		if (!writeTestFiles(dir, TestFiles, TestFileCount, paths))
+			FailCount++;
+		int ring = io.ringFd;
+		io.ringFd = open("/dev/null", O_RDONLY);
+		vector<vector<int> > ws;
+		vector<char> ok;
+		readCaptureFiles(io, paths, ws, ok);
+		bool fell = !io.uring;
+		readCaptureFiles(io, paths, ws, ok);
+		close(ring);
+		closeCaptureIO(io);
+		int bad = 0;
+		for (unsigned int k = 0; k < TestFileCount; k++)
+		{
+			vector<int> w;
+			loadVec(w, TestFiles[k].w);
+			if (!ok[k] || ws[k] != w)
+				bad++;
+		}
+		if (!fell || bad)
+		{
+			printf("ERROR: failed io_uring_enter, %d files wrong\n", bad);
+			FailCount++;
+		}
+		removeTestDir(dir, paths);
+	}
+	printf("testBatchedCaptureIO done\n");
+}
+
+// only the slots that changed should reach the disk
+void
+testDirtyRangeWrites()
+{
+	struct {
+		const char *oldW;
+		const char *newW;
+		bool appendOnly;
+		const char *ranges;	// off,len pairs in slots
+	} cases[] = {
+		{ "1,2,3", "1,2,3", false, "" },
+		{ "1,2,3", "1,2,3,4,5", true, "3,2" },
+		{ "1,2,3,4", "1,9,3,4", false, "1,1" },
+		{ "1,2,3,4", "1,2", false, "" },
+		{ "1,2,3", "1,0,3,7", false, "1,1,3,1" },
+		{ "", "5", true, "0,1" },
+	};
+	for (unsigned int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		vector<int> oldW, newW, want;
+		loadVec(oldW, cases[c].oldW);
+		loadVec(newW, cases[c].newW);
+		loadVec(want, cases[c].ranges);
+		vector<DirtyRange> ranges;
+		bool appendOnly;
+		diffFileVecs(oldW, newW, ranges, appendOnly);
+		vector<int> got;
+		for (unsigned int r = 0; r < ranges.size(); r++)
+		{
+			got.push_back(ranges[r].off / sizeof(int));
+			got.push_back(ranges[r].len / sizeof(int));
+		}
+		if (appendOnly != cases[c].appendOnly || got != want)
+		{
+			printf("ERROR: diffFileVecs %s -> %s\n", cases[c].oldW
+					, cases[c].newW);
+			FailCount++;
+		}
+	}
+
+	// changes closer than DirtyMergeGap share one write
+	vector<int> oldW(100, 7), newW(100, 7);
+	newW[10] = 1;
+	newW[12] = 1;
+	newW[90] = 1;
+	vector<DirtyRange> ranges;
+	bool appendOnly;
+	diffFileVecs(oldW, newW, ranges, appendOnly);
+	if (ranges.size() != 2 || ranges[0].len != 3 * sizeof(int))
+	{
+		printf("ERROR: diffFileVecs didn't merge nearby changes\n");
+		FailCount++;
+	}
+
+	// adding a slot to the end of the spec makes every file one int
+	// longer and otherwise unchanged
+	const TestFile files[] = {
+		{ "1,4,8,9", "1,4,8,9,0" },
+		{ "1,0,8,0", "1,0,8,0,0" },
+		{ "0,0,0,0", "0,0,0,0,0" },
+		{ "1,4,0,9", "1,4,0,9,0" }
+	};
+	const int count = sizeof(files) / sizeof(files[0]);
+	vector<int> a;
+	loadVec(a, "1,4,8,9,10");
+	SpecIndex si;
+	buildSpecIndex(si, a);
+	for (int mode = 0; mode < 2; mode++)
+	{
+		string dir;
+		if (!makeTestDir(dir))
+		{
+			FailCount++;
+			return;
+		}
+		vector<string> paths;
+		if (!writeTestFiles(dir, files, count, paths))
+			FailCount++;
+		CaptureIO io;
+		initCaptureIO(io, 8, mode == 0);
+		int n = resyncFilesBatched(io, si, paths, 3);
+		closeCaptureIO(io);
+		if (n != count || io.bytesWritten != count * sizeof(int))
+		{
+			printf("ERROR: dirty resync wrote %llu bytes\n"
+					, (unsigned long long)io.bytesWritten);
+			FailCount++;
+		}
+		for (int k = 0; k < count; k++)
+		{
+			vector<int> got, want;
+			loadVec(want, files[k].fixed);
+			if (!readCaptureFile(paths[k].c_str(), got) || got != want)
+			{
+				printf("ERROR: dirty resync of %s\n", files[k].w);
+				FailCount++;
+			}
+		}
+
+		// and a shrinking spec truncates
+		vector<int> small;
+		loadVec(small, "4,9");
+		SpecIndex ss;
+		buildSpecIndex(ss, small);
+		if (resyncFiles(ss, paths, 2) != count)
+			FailCount++;
+		for (int k = 0; k < count; k++)
+		{
+			vector<int> got, want;
+			loadVec(want, files[k].fixed);
+			reconcileIndexed(ss, want);
+			if (!readCaptureFile(paths[k].c_str(), got) || got != want)
+			{
+				printf("ERROR: truncating resync of %s\n", files[k].w);
+				FailCount++;
+			}
+		}
+		removeTestDir(dir, paths);
+	}
+	printf("testDirtyRangeWrites done\n");
+}
+
+off_t
+fileSize(const string &path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+// crash part way through a journaled rewrite, then recover
+void
+testResyncJournal()
+{
+	QuietLog quiet;
+	vector<int> a;
+	loadVec(a, TestSpec);
+
+	// the recorded script replays to the same result
+	for (unsigned int k = 0; k < TestFileCount; k++)
+	{
+		vector<int> fixed, replayed, script;
+		loadVec(fixed, TestFiles[k].w);
+		replayed = fixed;
+		fixVectors(a, fixed, &script);
+		applyEditScript(script, replayed);
+		if (replayed != fixed)
+		{
+			printf("ERROR: edit script for %s doesn't replay\n"
+					, TestFiles[k].w);
+			FailCount++;
+		}
+	}
+
+	// offsets and lengths past 4 GiB come back out of a BEGIN intact
+	{
+		const uint64_t big = 5ULL << 30;
+		const int undoId = 40;
+		vector<char> body;
+		putJournalU32(body, 3);
+		putJournalBytes(body, "big", 3);
+		putJournalU64(body, big / sizeof(int) + 1);
+		putJournalU64(body, big / sizeof(int));
+		putJournalU64(body, 0);
+		putJournalU64(body, 1);
+		putJournalU64(body, big);
+		putJournalU64(body, sizeof(int));
+		putJournalBytes(body, &undoId, sizeof(int));
+		JournalEntry e;
+		if (!parseJournalBegin(body, e) || e.path != "big"
+				|| e.oldLen != big / sizeof(int) + 1 || e.undo.size() != 1
+				|| e.undo[0].off != big || e.undoBytes.size() != sizeof(int))
+		{
+			printf("ERROR: journal offsets past 4 GiB don't round trip\n");
+			FailCount++;
+		}
+	}
+
+	for (int rollback = 0; rollback < 2; rollback++)
+	{
+		string dir;
+		if (!makeTestDir(dir))
+		{
+			FailCount++;
+			break;
+		}
+		vector<string> paths;
+		paths.push_back(dir + "/interrupted");
+		paths.push_back(dir + "/committed");
+		string jpath = dir + "/journal";
+		vector<int> spec, oldA, newA, oldB, newB, script;
+		loadVec(spec, "5,15,20,30,40");
+		loadVec(oldA, "5,10,15,20");
+		loadVec(oldB, "5,0,0,40");
+		writeCaptureFile(paths[0].c_str(), oldA);
+		writeCaptureFile(paths[1].c_str(), oldB);
+
+		Journal j;
+		if (!openJournal(j, jpath.c_str()))
+			FailCount++;
+		newB = oldB;
+		fixVectors(spec, newB, &script);
+		uint64_t seqB = journalBegin(j, paths[1], oldB, newB, script);
+		newA = oldA;
+		script.clear();
+		fixVectors(spec, newA, &script);
+		journalBegin(j, paths[0], oldA, newA, script);
+		journalSync(j);
+		writeCaptureFile(paths[1].c_str(), newB);
+		journalCommit(j, seqB);
+		journalSync(j);
+
+		// only the first changed range of A makes it out, and the
+		// last record is torn
+		vector<DirtyRange> ranges;
+		bool appendOnly;
+		diffFileVecs(oldA, newA, ranges, appendOnly);
+		int fd = open(paths[0].c_str(), O_WRONLY);
+		if (pwrite(fd, (char *)newA.data() + ranges[0].off, ranges[0].len
+				, ranges[0].off) != (ssize_t)ranges[0].len)
+			FailCount++;
+		close(fd);
+		journalBegin(j, paths[1], newB, oldB, script);
+		if (!writeFull(j.fd, j.pending.data(), j.pending.size() / 2))
+			FailCount++;
+		closeJournal(j);
+		// B is committed, so recovery must leave later changes alone
+		vector<int> laterB;
+		loadVec(laterB, "7,7");
+		writeCaptureFile(paths[1].c_str(), laterB);
+
+		int n = recoverJournal(jpath.c_str(), rollback);
+		vector<int> gotA, gotB;
+		readCaptureFile(paths[0].c_str(), gotA);
+		readCaptureFile(paths[1].c_str(), gotB);
+		if (n != 1 || gotA != (rollback ? oldA : newA) || gotB != laterB
+				|| fileSize(jpath) != 0)
+		{
+			printf("ERROR: journal recovery (%s) recovered %d\n"
+					, rollback ? "rollback" : "redo", n);
+			logVecs(gotA, gotB);
+			FailCount++;
+		}
+		paths.push_back(jpath);
+		removeTestDir(dir, paths);
+	}
+
+	// a file deleted after its record was written has nothing to
+	// restore; recovery skips it and still empties the journal
+	string dir;
+	if (!makeTestDir(dir))
+	{
+		FailCount++;
+		return;
+	}
+	vector<string> paths;
+	paths.push_back(dir + "/deleted");
+	string jpath = dir + "/journal";
+	{
+		vector<int> before, after, script;
+		loadVec(before, "5,0,0,40");
+		after = before;
+		fixVectors(a, after, &script);
+		writeCaptureFile(paths[0].c_str(), before);
+		Journal j;
+		if (!openJournal(j, jpath.c_str()))
+			FailCount++;
+		journalBegin(j, paths[0], before, after, script);
+		journalSync(j);
+		closeJournal(j);
+		unlink(paths[0].c_str());
+		int n = recoverJournal(jpath.c_str(), false);
+		if (n != 0 || fileSize(jpath) != 0)
+		{
+			printf("ERROR: recovery of a deleted file returned %d\n", n);
+			FailCount++;
+		}
+	}
+	paths.assign(1, jpath);
+	removeTestDir(dir, paths);
+
+	// a clean journaled resync: two journal syncs per batch, and
+	// nothing left in the journal afterwards
+	if (!makeTestDir(dir))
+	{
+		FailCount++;
+		return;
+	}
+	paths.clear();
+	if (!writeTestFiles(dir, TestFiles, TestFileCount, paths))
+		FailCount++;
+	jpath = dir + "/journal";
+	Journal j;
+	openJournal(j, jpath.c_str());
+	CaptureIO io;
+	initCaptureIO(io, 8, true);
+	int n = resyncFilesJournaled(io, j, a, paths, 4);
+	closeCaptureIO(io);
+	closeJournal(j);
+	if (n != (int)TestFileCount || j.syncs != 2 * 3 || fileSize(jpath) != 0)
+	{
+		printf("ERROR: journaled resync wrote %d, %u syncs\n", n, j.syncs);
+		FailCount++;
+	}
+	for (unsigned int k = 0; k < TestFileCount; k++)
+	{
+		vector<int> got, want;
+		loadVec(want, TestFiles[k].fixed);
+		if (!readCaptureFile(paths[k].c_str(), got) || got != want)
+		{
+			printf("ERROR: journaled resync of %s\n", TestFiles[k].w);
+			FailCount++;
+		}
+	}
+	paths.push_back(jpath);
+	removeTestDir(dir, paths);
+	printf("testResyncJournal done\n");
+}
+
+// the cheapest script is never dearer than the one fixVectors
+// finds, and still lands on the same result
+void
+testMinEditReconcile()
+{
+	QuietLog quiet;
+	EditCostModel models[] = { DefaultEditCosts, { 1, 1, 1, 1 }
+		, { 5, 1, 1, 2 } };
+	vector<int> a, w, fixedW, minW, script, fixScript;
+	srand(42);
+	for (int t = 0; t < 3000; t++)
+	{
+		// random spec and a file captured against a nearby spec
+		a.clear();
+		w.clear();
+		int id = 0;
+		int n = rand() % 12;
+		for (int i = 0; i < n; i++)
+		{
+			id += 1 + rand() % 3;
+			if (rand() % 4)
+				a.push_back(id);
+			if (rand() % 3 == 0)
+				continue;
+			w.push_back(rand() % 2 ? id : 0);
+		}
+		SpecIndex si;
+		buildSpecIndex(si, a);
+		const EditCostModel &cm = models[t % 3];
+
+		fixedW = w;
+		fixScript.clear();
+		if (!fixVectors(a, fixedW, &fixScript))
+			continue;
+		minW = w;
+		script.clear();
+		long cost = reconcileMinEdit(si, minW, cm, &script);
+		vector<int> replayed = w;
+		applyEditScript(script, replayed);
+		if (minW != fixedW || replayed != minW
+				|| cost != editScriptCost(w, script, cm)
+				|| cost > editScriptCost(w, fixScript, cm))
+		{
+			printf("ERROR: min-edit reconcile, cost %ld vs %ld\n", cost
+					, editScriptCost(w, fixScript, cm));
+			logVecs(a, w);
+			FailCount++;
+			break;
+		}
+	}
+
+	// keeping the first zero in place beats shifting all three
+	loadVec(a, "1,7");
+	loadVec(w, "0,0,0,7");
+	SpecIndex si;
+	buildSpecIndex(si, a);
+	script.clear();
+	long cost = reconcileMinEdit(si, w, DefaultEditCosts, &script);
+	if (cost != 2 + 4 || script.size() != 2)
+	{
+		printf("ERROR: min-edit cost %ld\n", cost);
+		FailCount++;
+	}
+
+	// captured ids out of order can't be fixed by edits
+	loadVec(w, "7,1");
+	if (reconcileMinEdit(si, w, DefaultEditCosts) != -1)
+		FailCount++;
+	printf("testMinEditReconcile done\n");
+}
+
+// bodies have to follow their ids without being copied
+void
+testRecordPayloads()
+{
+	vector<int> a, w;
+	loadVec(a, TestSpec);
+	SpecIndex si;
+	buildSpecIndex(si, a);
+	for (unsigned int k = 0; k < TestFileCount; k++)
+	{
+		loadVec(w, TestFiles[k].w);
+		vector<unique_ptr<string> > bodies;
+		vector<const string *> where;
+		for (unsigned int i = 0; i < w.size(); i++)
+		{
+			char body[32];
+			sprintf(body, "record %d", w[i]);
+			bodies.push_back(w[i] ? make_unique<string>(body) : nullptr);
+			where.push_back(bodies.back().get());
+		}
+		vector<int> want;
+		loadVec(want, TestFiles[k].fixed);
+		vector<int> orig = w;
+		reconcileRecords(si, w, bodies);
+		bool ok = (w == want && bodies.size() == w.size());
+		for (unsigned int i = 0; ok && i < w.size(); i++)
+		{
+			if (w[i] == 0)
+			{
+				ok = !bodies[i];
+				continue;
+			}
+			// the very same body, not a copy of it
+			unsigned int from = find(orig.begin(), orig.end(), w[i])
+				- orig.begin();
+			ok = bodies[i].get() == where[from];
+		}
+		if (!ok)
+		{
+			printf("ERROR: record payloads for %s\n", TestFiles[k].w);
+			FailCount++;
+		}
+
+		// and the same through an edit script
+		w = orig;
+		vector<string> texts;
+		for (unsigned int i = 0; i < w.size(); i++)
+			texts.push_back(w[i] ? to_string(w[i]) : "");
+		vector<int> fixedW = w, script;
+		{
+			QuietLog quiet;
+			fixVectors(a, fixedW, &script);
+		}
+		applyEditScript(script, w, texts);
+		for (unsigned int i = 0; i < w.size(); i++)
+			if (texts[i] != (w[i] ? to_string(w[i]) : ""))
+				ok = false;
+		if (!ok || w != want)
+		{
+			printf("ERROR: scripted record payloads for %s\n"
+					, TestFiles[k].w);
+			FailCount++;
+		}
+	}
+	printf("testRecordPayloads done\n");
+}
+
+// reconciling moves handles, never payloads, and compaction keeps
+// every surviving handle pointing at its own record
+void
+testPayloadStore()
+{
+	PayloadStore<string> ps;
+	initPayloadStore(ps);
+	vector<HandleFile> files(200);
+	for (unsigned int k = 0; k < files.size(); k++)
+	{
+		for (int id = 1; id <= 4; id++)
+		{
+			if ((k + id) % 3 == 0)
+			{
+				files[k].ids.push_back(0);
+				files[k].handles.push_back(0);
+				continue;
+			}
+			string body = to_string(k) + "/" + to_string(id);
+			files[k].ids.push_back(id);
+			files[k].handles.push_back(storePayload(ps, std::move(body)));
+		}
+	}
+
+	// drop ids 1 and 3, add 5
+	vector<int> a;
+	loadVec(a, "2,4,5");
+	SpecIndex si;
+	buildSpecIndex(si, a);
+	const string *before = &payloadOf(ps, files[0].handles[1]);
+	for (unsigned int k = 0; k < files.size(); k++)
+		reconcileHandles(si, files[k], ps);
+	if (&payloadOf(ps, files[0].handles[0]) != before || !compactionDue(ps))
+	{
+		printf("ERROR: payload moved, or compaction not due\n");
+		FailCount++;
+	}
+
+	vector<HandleFile *> users;
+	for (unsigned int k = 0; k < files.size(); k++)
+		users.push_back(&files[k]);
+	size_t live = ps.slots.size() - ps.dead;
+	compactPayloads(ps, users);
+	bool ok = (ps.slots.size() == live && !compactionDue(ps));
+	for (unsigned int k = 0; k < files.size(); k++)
+	{
+		for (unsigned int i = 0; i < files[k].ids.size(); i++)
+		{
+			int id = files[k].ids[i];
+			uint32_t h = files[k].handles[i];
+			if ((id == 0) != (h == 0))
+				ok = false;
+			else if (id && payloadOf(ps, h) != to_string(k) + "/"
+					+ to_string(id))
+				ok = false;
+		}
+	}
+	if (!ok)
+	{
+		printf("ERROR: payload store compaction\n");
+		FailCount++;
+	}
+	printf("testPayloadStore done\n");
+}
+
+void
+testValidateSync()
+{
+	struct {
+		const char *a;
+		const char *w;
+		SyncState want;
+	} cases[] = {
+		{ "1,2,3", "1,0,3", SYNC_OK },
+		{ "1,2,3", "0,0,0", SYNC_OK },
+		{ "", "", SYNC_OK },
+		{ "1,2,3", "1,0", SYNC_AFTER_SIZE_FIX },
+		{ "1,2,3", "", SYNC_AFTER_SIZE_FIX },
+		{ "1,2", "1,2,0,0", SYNC_AFTER_SIZE_FIX },
+		{ "1,2", "1,2,0,4", NEEDS_RECONCILE },
+		{ "1,2,3", "0,3", NEEDS_RECONCILE },
+		{ "1,2,3", "2,0,0", NEEDS_RECONCILE },
+		{ "1,2,3,4,5,6,7,8,9,10,11", "1,2,3,4,5,6,7,8,9,10,12"
+			, NEEDS_RECONCILE },
+		{ "1,2,3,4,5,6,7,8,9,10,11", "1,2,3,4,0,6,7,8,9,10,11"
+			, SYNC_OK },
+	};
+	QuietLog quiet;
+	for (unsigned int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		vector<int> a, w;
+		loadVec(a, cases[c].a);
+		loadVec(w, cases[c].w);
+		if (validateSync(a, w) != cases[c].want)
+		{
+			printf("ERROR: validateSync %s / %s\n", cases[c].a, cases[c].w);
+			FailCount++;
+		}
+		// the fast path must agree with a full reconcile
+		vector<int> fixedW = w, script;
+		SpecIndex si;
+		buildSpecIndex(si, a);
+		reconcileIndexed(si, w);
+		bool ok = fixVectors(a, fixedW, &script);
+		vector<int> replayed;
+		loadVec(replayed, cases[c].w);
+		applyEditScript(script, replayed);
+		if (!ok || fixedW != w || replayed != w)
+		{
+			printf("ERROR: fast path for %s / %s\n", cases[c].a, cases[c].w);
+			FailCount++;
+		}
+	}
+
+	// every offset of the vector loop and its tail
+	vector<int> a(37), w(37, 0);
+	for (unsigned int i = 0; i < a.size(); i++)
+		a[i] = i + 1;
+	for (unsigned int i = 0; i < a.size(); i++)
+	{
+		w[i] = 99;
+		if (firstOutOfSync(a.data(), w.data(), a.size()) != i)
+		{
+			printf("ERROR: firstOutOfSync missed slot %u\n", i);
+			FailCount++;
+		}
+		w[i] = a[i];
+	}
+	printf("testValidateSync done\n");
+}
+
+void
+testCapturedAllInSpec()
+{
+	vector<int> a, w;
+	for (int i = 1; i <= 10000; i++)
+		a.push_back(i * 3);
+	loadVec(w, "0,6,0,9,30000");
+	if (!capturedAllInSpec(a, w))
+		FailCount++;
+	loadVec(w, "0,6,7,9");
+	if (capturedAllInSpec(a, w))
+		FailCount++;
+	w.assign(100, 0);
+	if (!capturedAllInSpec(a, w))
+		FailCount++;
+	printf("testCapturedAllInSpec done\n");
+}
+
+// files stamped at every generation, brought up to the latest
+void
+testSpecGenerations()
+{
+	const char *specs[] = { "5,10,15,20", "5,10,15,20", "1,5,15,20,25"
+		, "1,5,15,25,30", "5,15,25,30,35,40" };
+	SpecRegistry reg;
+	initSpecRegistry(reg);
+	vector<uint32_t> gens;
+	for (unsigned int i = 0; i < sizeof(specs) / sizeof(specs[0]); i++)
+	{
+		vector<int> a;
+		loadVec(a, specs[i]);
+		gens.push_back(registerSpec(reg, a));
+	}
+	if (gens[0] != 1 || gens[1] != 1 || gens.back() != 4)
+	{
+		printf("ERROR: spec generations\n");
+		FailCount++;
+	}
+
+	QuietLog quiet;
+	uint32_t latest = gens.back();
+	const SpecIndex &last = reg.versions[latest-1].index;
+	const char *files[] = { "5,0,15,20", "0,10,0,0", "5,10,15", "7,0,0" };
+	for (uint32_t g = 1; g <= latest; g++)
+	{
+		for (unsigned int k = 0; k < sizeof(files) / sizeof(files[0]); k++)
+		{
+			// capture under generation g, then catch up
+			StampedFile f;
+			loadVec(f.w, files[k]);
+			f.generation = 0;
+			reconcileToGeneration(reg, f, g);
+			vector<int> want = f.w;
+			reconcileIndexed(last, want);
+			uint64_t deltas = reg.deltas, full = reg.full;
+			reconcileToGeneration(reg, f, latest);
+			if (f.w != want || f.generation != latest
+					|| reg.deltas - deltas != latest - g || reg.full != full)
+			{
+				printf("ERROR: generation %u -> %u of %s\n", g, latest
+						, files[k]);
+				FailCount++;
+			}
+			// and again costs nothing
+			uint64_t current = reg.current;
+			if (reconcileToGeneration(reg, f, latest) != 0
+					|| reg.current != current + 1)
+				FailCount++;
+			// a stamp from somewhere else isn't trusted
+			f.specHash ^= 1;
+			full = reg.full;
+			reconcileToGeneration(reg, f, latest);
+			if (reg.full != full + 1 || f.w != want)
+				FailCount++;
+		}
+	}
+
+	// generations that were never registered are refused
+	StampedFile f;
+	loadVec(f.w, "5,0,15");
+	f.generation = 1;
+	f.specHash = reg.versions[0].hash;
+	vector<int> w = f.w;
+	if (reconcileToGeneration(reg, f, 0) != -1
+			|| reconcileToGeneration(reg, f, latest + 1) != -1
+			|| f.w != w || f.generation != 1)
+	{
+		printf("ERROR: bad generation accepted\n");
+		FailCount++;
+	}
+	printf("testSpecGenerations done\n");
+}
+
+// calls from this thread and from one that has already exited all
+// show up, and the export is well formed
+void
+testReconcileStats()
+{
+	// the shared files, plus one already in sync
+	const unsigned int count = TestFileCount + 1;
+	vector<int> a;
+	loadVec(a, TestSpec);
+	StatsSnapshot before, after;
+	snapshotStats(before);
+	StatsEnabled = true;
+
+	uint64_t edits = 0;
+	uint64_t slots = 0;
+	auto runAll = [&](bool countEdits) {
+		QuietLog quiet;
+		for (unsigned int k = 0; k < count; k++)
+		{
+			vector<int> w, script;
+			loadVec(w, (k < TestFileCount) ? TestFiles[k].w : TestSpec);
+			if (countEdits)
+			{
+				slots += w.size();
+				fixVectors(a, w, &script);
+				edits += script.size();
+			}
+			else
+				fixVectors(a, w);
+		}
+	};
+	runAll(true);
+	thread t(runAll, false);
+	t.join();
+	StatsEnabled = false;
+	snapshotStats(after);
+
+	uint64_t calls = after.hist[STAT_SLOTS].count
+		- before.hist[STAT_SLOTS].count;
+	if (calls != 2 * count
+			|| after.hist[STAT_EDITS].sum - before.hist[STAT_EDITS].sum
+				!= 2 * edits
+			|| after.hist[STAT_SLOTS].sum - before.hist[STAT_SLOTS].sum
+				!= 2 * slots
+			|| after.hist[STAT_BYTES_MOVED].sum
+				== before.hist[STAT_BYTES_MOVED].sum)
+	{
+		printf("ERROR: reconcile stats counted %llu calls\n"
+				, (unsigned long long)calls);
+		FailCount++;
+	}
+	// the one file already in sync is a no-op, and only the calls
+	// that ran the phases are in the phase histograms
+	uint64_t outcomes[OUTCOME_KINDS];
+	uint64_t total = 0;
+	for (unsigned int k = 0; k < OUTCOME_KINDS; k++)
+	{
+		outcomes[k] = after.outcomes[k] - before.outcomes[k];
+		total += outcomes[k];
+	}
+	if (total != calls || outcomes[OUTCOME_NOOP] != 2
+			|| after.hist[STAT_FIXINGW_NS].count
+				- before.hist[STAT_FIXINGW_NS].count
+				!= outcomes[OUTCOME_RECONCILED] + outcomes[OUTCOME_FAILED])
+	{
+		printf("ERROR: reconcile outcomes, %llu no-ops\n"
+				, (unsigned long long)outcomes[OUTCOME_NOOP]);
+		FailCount++;
+	}
+
+	string text;
+	formatStatsPrometheus(after, text);
+	char want[128];
+	snprintf(want, sizeof(want), "seqmodify_reconcile_slots_count %llu\n"
+			, (unsigned long long)after.hist[STAT_SLOTS].count);
+	if (text.find(want) == string::npos
+			|| text.find("# TYPE seqmodify_fixingw_phase_seconds histogram")
+				== string::npos
+			|| text.find("seqmodify_reconcile_edits_bucket{le=\"+Inf\"}")
+				== string::npos
+			|| text.find("seqmodify_reconcile_calls_total{outcome=\"noop\"}")
+				== string::npos)
+	{
+		printf("ERROR: prometheus export\n%s", text.c_str());
+		FailCount++;
+	}
+
+	string dir;
+	if (makeTestDir(dir))
+	{
+		vector<string> paths(1, dir + "/seqmodify.prom");
+		string got;
+		char buf[4096];
+		int fd = -1;
+		ssize_t n;
+		if (writeStatsFile(paths[0].c_str())
+				&& (fd = open(paths[0].c_str(), O_RDONLY)) >= 0)
+		{
+			while ((n = read(fd, buf, sizeof(buf))) > 0)
+				got.append(buf, n);
+			close(fd);
+		}
+		if (got != text)
+		{
+			printf("ERROR: stats file\n");
+			FailCount++;
+		}
+		removeTestDir(dir, paths);
+	}
+	printf("testReconcileStats done\n");
+}
+
+// capture everything (threshold 0), then nothing, and read it back
+void
+testReplayCapture()
+{
+	const unsigned int count = TestFileCount;
+	vector<int> a;
+	loadVec(a, TestSpec);
+	string dir;
+	if (!makeTestDir(dir))
+	{
+		FailCount++;
+		return;
+	}
+	vector<string> paths(1, dir + "/slow.replay");
+	QuietLog quiet;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		startReplayCapture(paths[0].c_str(), pass ? UINT64_MAX : 0);
+		for (unsigned int k = 0; k < count; k++)
+		{
+			vector<int> w, script;
+			loadVec(w, TestFiles[k].w);
+			fixVectors(a, w, (k & 1) ? &script : NULL);
+		}
+		if (stopReplayCapture() != (pass ? 0 : count))
+			FailCount++;
+	}
+
+	vector<ReplayCase> cases;
+	if (!loadReplayFile(paths[0].c_str(), cases) || cases.size() != count)
+	{
+		printf("ERROR: replay file has %u calls\n", (unsigned)cases.size());
+		FailCount++;
+	}
+	for (unsigned int k = 0; k < cases.size(); k++)
+	{
+		vector<int> w;
+		loadVec(w, TestFiles[k].w);
+		uint32_t flags = (k & 1) ? REPLAY_SCRIPT : 0;
+		if (cases[k].spec != a || cases[k].w != w
+				|| cases[k].flags != flags || !replayCase(cases[k]))
+		{
+			printf("ERROR: replay of %s\n", TestFiles[k].w);
+			FailCount++;
+		}
+	}
+
+	// starting and stopping capture under calls running on other
+	// threads: every record a stop counts is whole in the file
+	unlink(paths[0].c_str());
+	atomic<bool> stop(false);
+	vector<thread> callers;
+	for (int t = 0; t < 4; t++)
+	{
+		callers.push_back(thread([&, t]() {
+			QuietLog quiet;
+			for (unsigned int i = t; !stop; i++)
+			{
+				vector<int> w;
+				loadVec(w, TestFiles[i % count].w);
+				fixVectors(a, w);
+			}
+		}));
+	}
+	uint64_t captured = 0;
+	for (int i = 0; i < 50; i++)
+	{
+		startReplayCapture(paths[0].c_str(), 0);
+		this_thread::yield();
+		captured += stopReplayCapture();
+	}
+	stop = true;
+	for (unsigned int t = 0; t < callers.size(); t++)
+		callers[t].join();
+	if (!loadReplayFile(paths[0].c_str(), cases) || cases.size() != captured)
+	{
+		printf("ERROR: %u of %llu concurrent replay records\n"
+				, (unsigned)cases.size(), (unsigned long long)captured);
+		FailCount++;
+	}
+	removeTestDir(dir, paths);
+	printf("testReplayCapture done\n");
+}
+
+// small files stay inline and reconcile like the big ones
+void
+testSmallFileVec()
+{
+	SmallFileVec v;
+	for (int i = 1; i <= 40; i++)
+	{
+		v.push_back(i);
+		if (v.onHeap() != (i > (int)SmallFileSlots))
+		{
+			printf("ERROR: SmallVec spilled at %d\n", i);
+			FailCount++;
+			break;
+		}
+	}
+	SmallFileVec moved(std::move(v));
+	if (!moved.onHeap() || moved.size() != 40 || v.size() != 0
+			|| moved[39] != 40)
+		FailCount++;
+	QuietLog quiet;
+	insPos(0, moved);
+	delPos(41, moved);
+	if (moved.size() != 40 || moved[0] != 0 || moved[39] != 39)
+		FailCount++;
+
+	srand(7);
+	for (int t = 0; t < 5000; t++)
+	{
+		// captured against an older spec, zeros padded anywhere,
+		// and every so often too big to stay inline
+		vector<int> old, a, w;
+		int id = 0;
+		int n = rand() % ((t % 50 == 0) ? 60 : 20);
+		for (int i = 0; i < n; i++)
+		{
+			id += 1 + rand() % 3;
+			old.push_back(id);
+		}
+		for (unsigned int i = 0; i < old.size(); i++)
+		{
+			if (rand() % 4)
+				w.push_back(rand() % 2 ? old[i] : 0);
+			if (rand() % 5 == 0)
+				w.push_back(0);
+		}
+		for (int x = 1; x <= id + 3; x++)
+		{
+			bool inOld = binary_search(old.begin(), old.end(), x);
+			if (inOld ? rand() % 4 != 0 : rand() % 3 == 0)
+				a.push_back(x);
+		}
+
+		SmallFileVec sw;
+		sw.assign(w.data(), w.size());
+		vector<int> script, smallScript;
+		vector<int> fixedW = w;
+		bool ok = fixVectors(a, fixedW, &script);
+		bool smallOk = fixVectors(a, sw, &smallScript);
+		if (ok != smallOk || sw.size() != fixedW.size()
+				|| !equal(fixedW.begin(), fixedW.end(), sw.begin())
+				|| smallScript != script)
+		{
+			printf("ERROR: small fixVectors differs\n");
+			logVecs(a, w);
+			FailCount++;
+			break;
+		}
+	}
+
+	// calls on a SmallFileVec are counted like any other
+	vector<int> a;
+	SmallFileVec w;
+	loadVec(a, "5,10,15,20");
+	w.push_back(5);
+	w.push_back(15);
+	StatsSnapshot before, after;
+	snapshotStats(before);
+	StatsEnabled = true;
+	fixVectors(a, w);
+	StatsEnabled = false;
+	snapshotStats(after);
+	if (after.hist[STAT_SLOTS].count - before.hist[STAT_SLOTS].count != 1
+			|| after.outcomes[OUTCOME_RECONCILED]
+				- before.outcomes[OUTCOME_RECONCILED] != 1
+			|| w.size() != 4 || w[2] != 15 || w.onHeap())
+	{
+		printf("ERROR: SmallFileVec call not recorded\n");
+		FailCount++;
+	}
+	printf("testSmallFileVec done\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc == 3 && strcmp(argv[1], "serve") == 0)
+	{
+		int listenFd = openServerSocket(argv[2]);
+		if (listenFd < 0)
+		{
+			printf("cannot listen on %s\n", argv[2]);
+			return 1;
+		}
+		runReconcileServer(listenFd);
+		unlink(argv[2]);
+		return 0;
+	}
+	if (argc >= 4 && strcmp(argv[1], "client") == 0)
+		return runClientCommand(argc, argv);
+	if (argc >= 3 && strcmp(argv[1], "resync") == 0)
+		return runResyncCommand(argc, argv);
+	if (argc == 3 && strcmp(argv[1], "replay") == 0)
+		return runReplayCommand(argv[2]);
+	if (argc == 2 && strcmp(argv[1], "bench") == 0)
+	{
+		runBench();
+		return 0;
+	}
+
+	printf("hello w\n");
+	vector<int> asVec;
+	vector<int> wfVec;
+
+	loadVec(asVec, "1,2,3");
+	loadVec(wfVec, "1,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,3");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "1,3");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "5,10,15,20");
+	loadVec(wfVec, "0,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,10,15");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "10,15");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,15");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,6,10");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,10,15,20,25");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,0,0,20,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,0,0,0,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,10,15,0,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,0,0,0,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,0,0,0,40");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,0,0,40");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "5,10,15,20");
+	loadVec(wfVec, "5,6,15");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "1,5,10,15,20");
+	loadVec(wfVec, "5,6,15,17");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "15,20");
+	loadVec(wfVec, "5,6,15,17,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "15,20");
+	loadVec(wfVec, "0,6,0,17,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "1,5,10,15,17,18");
+	loadVec(wfVec, "1,5,10,15,17,18");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "1,5,11,15,17,18");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "1,5,0,15,17,18");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,0,0,15,17,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "18");
+	loadVec(wfVec, "0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "");
+	loadVec(wfVec, "");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "5,10,15,16,20,25");
+	loadVec(wfVec, "10,15,20,25");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,15,20,25");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "5,10,15,16,20,25");
+	loadVec(wfVec, "0,5,10,15,16,20,25");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "5,10,15,16,20,25");
+	loadVec(wfVec, "0,5,10,15,16,20,25,29");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "5,10,15,0,0,16,20,25");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,0,5,10,15,16,20,25,29");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,5,10,16,20,0,25");
+	fixVectors(asVec, wfVec);
+
+	loadVec(wfVec, "0,5,10,15,0,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "");
+	loadVec(wfVec, "0,5,0");
+	fixVectors(asVec, wfVec);
+
+	loadVec(asVec, "3,13,23");
+	loadVec(wfVec, "");
+	fixVectors(asVec, wfVec);
+
+	testReconcileServer();
+	testSpecIndexCache();
+	testSpecTransitionTable();
+	testTransitionPlan();
+	testFixVectorsParallel();
+	testFileSnapshot();
+	testFileVecPublisher();
+	testPublisherOverflow();
+	testCaptureDuringResync();
+	testScanPrimitives();
+	testReconcileBatch();
+	testResyncPipeline();
+	testBatchedCaptureIO();
+	testDirtyRangeWrites();
+	testResyncJournal();
+	testMinEditReconcile();
+	testRecordPayloads();
+	testPayloadStore();
+	testValidateSync();
+	testCapturedAllInSpec();
+	testSpecGenerations();
+	testReconcileStats();
+	testReplayCapture();
+	testSmallFileVec();
+
+	if (FailCount)
+		printf("%d test(s) FAILED\n", FailCount.load());
+	return 0;
+}